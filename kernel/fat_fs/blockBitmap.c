@@ -0,0 +1,172 @@
+// Bitmap of the free blocks in the data region of a mounted filesystem. The 
+// bitmap is packed, one bit per block, so that a whole 64-bit word of blocks can
+// be checked at once. Bit (i - 1) is set iff block i is free. A rotor remembers 
+// the word the last free block was found in, so a sequence of allocations does 
+// not rescan the full words at the start of the bitmap every time
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "headers.h"
+#include "blockBitmap.h"
+
+// Masks used to detect zero FAT entries four at a time in a 64-bit word
+#define LANE_LOW_BITS 0x7fff7fff7fff7fffULL
+#define LANE_GATHER 0x0001000200040008ULL
+
+// Function to find which of four consecutive FAT entries are 0, without a branch
+// per entry. Entry j is held in bits 16j to 16j+15 of the word
+// Arguments: 
+//     entries: Four FAT entries packed into a 64-bit word
+// Returns: 
+//     A 4-bit mask with bit j set iff entry j is 0
+static uint64_t zeroEntries(uint64_t entries) {
+    // The top bit of each 16-bit lane is set iff the lane is 0: adding 0x7fff to 
+    // the low 15 bits of a lane carries into its top bit iff they are nonzero
+    uint64_t zero = ~(((entries & LANE_LOW_BITS) + LANE_LOW_BITS) | entries | LANE_LOW_BITS);
+    // Gather the top bits of the four lanes into bits 48 to 51
+    return (((zero >> 15) * LANE_GATHER) >> 48) & 0xf;
+}
+
+// Function to build the bitmap of free blocks of a filesystem from its FAT. A 
+// block is free iff its FAT entry is 0. The FAT is already in memory, so this is 
+// a single sequential pass over it that checks four entries per 64-bit load and
+// fills a word of the bitmap at a time. Any previous bitmap is discarded
+// Arguments: 
+//     fs: The filesystem whose bitmap to build
+// Returns: 
+//     None
+void buildBitmap(fileSystem *fs) {
+    free(fs -> bitmap);
+    fs -> bitmapWords = (fs -> numBlocks + 63) / 64;
+    fs -> bitmap = malloc(fs -> bitmapWords * sizeof(uint64_t));
+    fs -> freeHint = 0;
+
+    // Bit i of the bitmap is for block i + 1, so FAT entries are read from entry 1
+    const uint16_t *entries = fs -> fat + 1;
+    int fullWords = fs -> numBlocks / 64;
+    for (int word = 0; word < fullWords; word++) {
+        uint64_t freeBits = 0;
+        for (int i = 0; i < 64; i += 4) {
+            uint64_t packed;
+            memcpy(&packed, entries + word * 64 + i, sizeof(packed));
+            freeBits |= zeroEntries(packed) << i;
+        }
+        fs -> bitmap[word] = freeBits;
+    }
+    // The last word may only be partly used by blocks
+    if (fullWords < fs -> bitmapWords) {
+        uint64_t freeBits = 0;
+        for (int i = fullWords * 64; i < fs -> numBlocks; i++) {
+            if (entries[i] == 0) 
+                freeBits |= 1ULL << (i % 64);
+        }
+        fs -> bitmap[fullWords] = freeBits;
+    }
+
+    // Block 0xffff can never be allocated, since 0xffff marks the end of a chain
+    if (fs -> numBlocks >= 0xffff) 
+        fs -> bitmap[(0xffff - 1) / 64] &= ~(1ULL << ((0xffff - 1) % 64));
+}
+
+// Function to free the bitmap of a filesystem
+// Arguments: 
+//     fs: The filesystem whose bitmap to free
+// Returns: 
+//     None
+void freeBitmap(fileSystem *fs) {
+    free(fs -> bitmap);
+    fs -> bitmap = NULL;
+    fs -> bitmapWords = 0;
+}
+
+// Function to find a free block in the data region of the filesystem. The search 
+// starts at the word of the bitmap the previous search stopped at and wraps 
+// around, checking 64 blocks at a time
+// Arguments: 
+//     fs: The filesystem
+// Returns: 
+//     -1 on error (eg: there are no free blocks), or the number of a free block
+//     otherwise
+int findFreeBlock(fileSystem *fs) {
+    for (int i = 0; i < fs -> bitmapWords; i++) {
+        int word = (fs -> freeHint + i) % fs -> bitmapWords;
+        if (fs -> bitmap[word] != 0) {
+            fs -> freeHint = word;
+            return word * 64 + __builtin_ctzll(fs -> bitmap[word]) + 1;
+        }
+    }
+    return -1;
+}
+
+// Function to find a run of consecutive free blocks in the data region of the 
+// filesystem. The search starts at the word of the bitmap the last free block 
+// was found in and wraps around. Words with no free blocks are skipped, and words
+// whose blocks are all free are counted at once
+// Arguments: 
+//     fs: The filesystem
+//     length: Number of consecutive free blocks wanted
+// Returns: 
+//     -1 if there is no such run, or the number of the first block of the run 
+//     otherwise
+int findFreeRun(fileSystem *fs, int length) {
+    int start = fs -> freeHint * 64; // Bit the search starts at
+    for (int pass = 0; pass < 2; pass++) {
+        // The second pass covers the bits before start, and the runs that begin
+        // there and continue past start
+        int from = (pass == 0) ? start : 0;
+        int to = (pass == 0) ? fs -> numBlocks : start + length - 1;
+        if (to > fs -> numBlocks) to = fs -> numBlocks;
+
+        int runLength = 0; // Number of free bits just before bit i
+        for (int i = from; i < to; ) {
+            uint64_t word = fs -> bitmap[i / 64];
+            if (i % 64 == 0 && word == 0) {
+                runLength = 0;
+                i += 64;
+            } else if (i % 64 == 0 && word == ~0ULL && i + 64 <= to) {
+                if (runLength + 64 >= length) 
+                    return i - runLength + 1;
+                runLength += 64;
+                i += 64;
+            } else {
+                runLength = ((word >> (i % 64)) & 1) ? runLength + 1 : 0;
+                if (runLength == length) 
+                    return i - length + 2;
+                i++;
+            }
+        }
+    }
+    return -1;
+}
+
+// Function to mark a block as occupied in the bitmap
+// Arguments: 
+//     fs: The filesystem
+//     block: The block number
+// Returns: 
+//     None
+void markBlockUsed(fileSystem *fs, int block) {
+    fs -> bitmap[(block - 1) / 64] &= ~(1ULL << ((block - 1) % 64));
+}
+
+// Function to mark a block as free in the bitmap
+// Arguments: 
+//     fs: The filesystem
+//     block: The block number
+// Returns: 
+//     None
+void markBlockFree(fileSystem *fs, int block) {
+    fs -> bitmap[(block - 1) / 64] |= 1ULL << ((block - 1) % 64);
+}
+
+// Function to check whether a block is free
+// Arguments: 
+//     fs: The filesystem
+//     block: The block number
+// Returns: 
+//     1 if the block is free, 0 otherwise
+int isBlockFree(fileSystem *fs, int block) {
+    return (fs -> bitmap[(block - 1) / 64] >> ((block - 1) % 64)) & 1;
+}
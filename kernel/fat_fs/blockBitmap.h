@@ -0,0 +1,15 @@
+#ifndef BLOCK_BITMAP_H
+#define BLOCK_BITMAP_H
+
+#include <stdint.h>
+#include "headers.h"
+
+void buildBitmap(fileSystem *fs);
+void freeBitmap(fileSystem *fs);
+int findFreeBlock(fileSystem *fs);
+int findFreeRun(fileSystem *fs, int length);
+void markBlockUsed(fileSystem *fs, int block);
+void markBlockFree(fileSystem *fs, int block);
+int isBlockFree(fileSystem *fs, int block);
+
+#endif
@@ -0,0 +1,249 @@
+// Index of the root directory. Maps file names to the location of their directory
+// entries so that files can be found without scanning the directory, and keeps a
+// list of the slots of deleted entries and the position of the end of the 
+// directory so that new entries can be placed without scanning it either. The 
+// index is built once when the filesystem is mounted and is kept up to date by 
+// the functions that create and delete files
+
+#include <stdio.h>
+#include <sys/types.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "headers.h"
+#include "dirIndex.h"
+#include "touch.h"
+#include "fatCache.h"
+#include "image.h"
+
+// Definition for the initial number of buckets of the index
+#define INITIAL_BUCKETS 64
+// Definition for the initial number of free slots the index has room for
+#define INITIAL_FREE_SLOTS 16
+
+// Function to hash a file name (FNV-1a)
+// Arguments: 
+//     fileName: The name to hash
+// Returns: 
+//     The hash of fileName
+static uint32_t hashName(char *fileName) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < NAME_SIZE && fileName[i] != '\0'; i++) {
+        hash ^= (uint8_t) fileName[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Function to double the number of buckets of the index and redistribute the
+// entries among the new buckets
+// Arguments: 
+//     index: The index to grow
+// Returns: 
+//     None
+static void growDirIndex(dirIndex *index) {
+    int numBuckets = index -> numBuckets * 2;
+    indexEntry **buckets = calloc(numBuckets, sizeof(indexEntry*));
+    for (int i = 0; i < index -> numBuckets; i++) {
+        indexEntry *entry = index -> buckets[i];
+        while (entry != NULL) {
+            indexEntry *next = entry -> next;
+            uint32_t bucket = hashName(entry -> name) & (numBuckets - 1);
+            entry -> next = buckets[bucket];
+            buckets[bucket] = entry;
+            entry = next;
+        }
+    }
+    free(index -> buckets);
+    index -> buckets = buckets;
+    index -> numBuckets = numBuckets;
+}
+
+// Function to build the directory index of a filesystem by scanning its root 
+// directory once. Each block of the directory is read with a single read
+// Arguments: 
+//     fs: The filesystem whose index to build
+// Returns: 
+//     0 on success, -1 on failure
+int buildDirIndex(fileSystem *fs) {
+    freeDirIndex(fs);
+    fs -> index.numBuckets = INITIAL_BUCKETS;
+    fs -> index.buckets = calloc(INITIAL_BUCKETS, sizeof(indexEntry*));
+    fs -> index.count = 0;
+    fs -> index.freeSlotsSize = INITIAL_FREE_SLOTS;
+    fs -> index.freeSlots = malloc(INITIAL_FREE_SLOTS * sizeof(off_t));
+    fs -> index.numFreeSlots = 0;
+
+    char *block = malloc(fs -> blockSize);
+    int currBlock = 1; // Current block we are at in the directory
+    while (1) {
+        off_t blockOffset = fs -> fatSize + (currBlock - 1) * fs -> blockSize;
+        if (imageRead(fs, blockOffset, block, fs -> blockSize) != fs -> blockSize) {
+            free(block);
+            return -1;
+        }
+        for (int currLoc = 0; currLoc < fs -> blockSize; currLoc += DIR_ENTRY_SIZE) {
+            dirEntry *entry = (dirEntry*)(block + currLoc);
+            // Stop at the end of the directory and skip deleted entries
+            if (entry -> name[0] == DIR_END) {
+                fs -> index.end = blockOffset + currLoc;
+                fs -> index.endBlock = currBlock;
+                free(block);
+                return 0;
+            }
+            if (entry -> name[0] == DEL_FILE_1) {
+                addFreeSlot(fs, blockOffset + currLoc);
+                continue;
+            }
+            // A file that was unlinked while open is released by its last close,
+            // so if it is still here the image was not unmounted cleanly. No 
+            // file is open yet, so release it now
+            if (entry -> name[0] == DEL_FILE_2) {
+                fileHandle handle = {blockOffset + currLoc, entry -> firstBlock};
+                releaseFile(fs, &handle);
+                continue;
+            }
+            char name[NAME_SIZE + 1];
+            strncpy(name, entry -> name, NAME_SIZE);
+            name[NAME_SIZE] = '\0';
+            addToDirIndex(fs, name, blockOffset + currLoc, entry -> firstBlock);
+        }
+        // The directory has no end marker if its last block is full
+        uint16_t nextBlock = getFatEntry(fs, currBlock);
+        if (nextBlock == 0xffff) {
+            fs -> index.end = -1;
+            fs -> index.endBlock = currBlock;
+            break;
+        }
+        currBlock = nextBlock;
+    }
+
+    free(block);
+    return 0;
+}
+
+// Function to free the directory index of a filesystem
+// Arguments: 
+//     fs: The filesystem whose index to free
+// Returns: 
+//     None
+void freeDirIndex(fileSystem *fs) {
+    for (int i = 0; i < fs -> index.numBuckets; i++) {
+        indexEntry *entry = fs -> index.buckets[i];
+        while (entry != NULL) {
+            indexEntry *next = entry -> next;
+            free(entry);
+            entry = next;
+        }
+    }
+    free(fs -> index.buckets);
+    fs -> index.buckets = NULL;
+    fs -> index.numBuckets = 0;
+    fs -> index.count = 0;
+    free(fs -> index.freeSlots);
+    fs -> index.freeSlots = NULL;
+    fs -> index.numFreeSlots = 0;
+    fs -> index.freeSlotsSize = 0;
+}
+
+// Function to look up a file in the directory index
+// Arguments: 
+//     fs: The filesystem
+//     fileName: Name of the file to look up
+// Returns: 
+//     NULL if the file does not exist, otherwise a pointer to the file's index 
+//     entry
+indexEntry *lookupDirIndex(fileSystem *fs, char *fileName) {
+    if (fs -> index.numBuckets == 0 || strlen(fileName) > NAME_SIZE) return NULL;
+
+    uint32_t bucket = hashName(fileName) & (fs -> index.numBuckets - 1);
+    indexEntry *entry = fs -> index.buckets[bucket];
+    while (entry != NULL) {
+        if (strcmp(entry -> name, fileName) == 0) return entry;
+        entry = entry -> next;
+    }
+
+    return NULL;
+}
+
+// Function to add a file to the directory index. Assumes the file is not in the
+// index yet
+// Arguments: 
+//     fs: The filesystem
+//     fileName: Name of the file
+//     offset: Offset of the file's directory entry in the filesystem image
+//     firstBlock: First block of the file
+// Returns: 
+//     A pointer to the new index entry
+indexEntry *addToDirIndex(fileSystem *fs, char *fileName, off_t offset, uint16_t firstBlock) {
+    dirIndex *index = &(fs -> index);
+    // Keep the average bucket length at most 1
+    if (index -> count >= index -> numBuckets) 
+        growDirIndex(index);
+
+    indexEntry *entry = malloc(sizeof(indexEntry));
+    strncpy(entry -> name, fileName, NAME_SIZE);
+    entry -> name[NAME_SIZE] = '\0';
+    entry -> handle.entryOffset = offset;
+    entry -> handle.firstBlock = firstBlock;
+    entry -> handle.cursorIndex = 0;
+    entry -> handle.cursorBlock = firstBlock;
+    entry -> handle.cursorGeneration = fs -> freeGeneration;
+
+    uint32_t bucket = hashName(entry -> name) & (index -> numBuckets - 1);
+    entry -> next = index -> buckets[bucket];
+    index -> buckets[bucket] = entry;
+    index -> count += 1;
+
+    return entry;
+}
+
+// Function to remove a file from the directory index. Does nothing if the file 
+// is not in the index
+// Arguments: 
+//     fs: The filesystem
+//     fileName: Name of the file to remove
+// Returns: 
+//     None
+void removeFromDirIndex(fileSystem *fs, char *fileName) {
+    if (fs -> index.numBuckets == 0) return;
+
+    uint32_t bucket = hashName(fileName) & (fs -> index.numBuckets - 1);
+    indexEntry **link = &(fs -> index.buckets[bucket]);
+    while (*link != NULL) {
+        if (strcmp((*link) -> name, fileName) == 0) {
+            indexEntry *entry = *link;
+            *link = entry -> next;
+            free(entry);
+            fs -> index.count -= 1;
+            return;
+        }
+        link = &((*link) -> next);
+    }
+}
+
+// Function to add the slot of a deleted directory entry to the free slots of the 
+// directory, doubling the room for free slots if it is full
+// Arguments: 
+//     fs: The filesystem
+//     offset: Offset of the slot in the filesystem image
+// Returns: 
+//     None
+void addFreeSlot(fileSystem *fs, off_t offset) {
+    dirIndex *index = &(fs -> index);
+    if (index -> numFreeSlots == index -> freeSlotsSize) {
+        index -> freeSlotsSize *= 2;
+        index -> freeSlots = realloc(index -> freeSlots, index -> freeSlotsSize * sizeof(off_t));
+    }
+    index -> freeSlots[index -> numFreeSlots++] = offset;
+}
+
+// Function to take a free slot of the directory, for a new directory entry
+// Arguments: 
+//     fs: The filesystem
+// Returns: 
+//     Offset of the slot in the filesystem image, or -1 if there are no free slots
+off_t takeFreeSlot(fileSystem *fs) {
+    if (fs -> index.numFreeSlots == 0) return -1;
+    return fs -> index.freeSlots[--(fs -> index.numFreeSlots)];
+}
@@ -0,0 +1,15 @@
+#ifndef DIR_INDEX_H
+#define DIR_INDEX_H
+
+#include <stdint.h>
+#include "headers.h"
+
+int buildDirIndex(fileSystem *fs);
+void freeDirIndex(fileSystem *fs);
+indexEntry *lookupDirIndex(fileSystem *fs, char *fileName);
+indexEntry *addToDirIndex(fileSystem *fs, char *fileName, off_t offset, uint16_t firstBlock);
+void removeFromDirIndex(fileSystem *fs, char *fileName);
+void addFreeSlot(fileSystem *fs, off_t offset);
+off_t takeFreeSlot(fileSystem *fs);
+
+#endif
@@ -0,0 +1,109 @@
+// In-memory copy of the FAT. The whole FAT region is read into memory once when
+// the filesystem is mounted, all chain lookups are served from memory, and
+// modified entries are written back to the filesystem file in batches by syncFat.
+// If the image is mounted with IMAGE_MMAP, the FAT is used in place in the mapping
+
+#include <stdio.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "headers.h"
+#include "fatCache.h"
+#include "image.h"
+
+// Function to load the FAT of a mounted filesystem image into memory. Reads the
+// whole FAT region with a single read, or uses the FAT in place if the image is
+// mapped. Any previously loaded FAT is discarded
+// Arguments: 
+//     fs: The filesystem whose FAT to load
+// Returns: 
+//     0 on success, -1 on failure (eg: the filesystem file could not be read)
+int loadFat(fileSystem *fs) {
+    unloadFat(fs);
+    fs -> fatDirty = calloc(fs -> fatSize / fs -> blockSize, sizeof(char));
+
+    fs -> fat = (uint16_t*) imageAddress(fs, 0);
+    fs -> fatMapped = (fs -> fat != NULL);
+    if (fs -> fatMapped) return 0;
+
+    fs -> fat = malloc(fs -> fatSize);
+    if (imageRead(fs, 0, fs -> fat, fs -> fatSize) != fs -> fatSize) 
+        return -1;
+
+    return 0;
+}
+
+// Function to discard the in-memory FAT of a filesystem. Modified entries that 
+// have not been written back with syncFat are lost
+// Arguments: 
+//     fs: The filesystem whose FAT to discard
+// Returns: 
+//     None
+void unloadFat(fileSystem *fs) {
+    if (!(fs -> fatMapped)) free(fs -> fat);
+    free(fs -> fatDirty);
+    fs -> fat = NULL;
+    fs -> fatDirty = NULL;
+    fs -> fatMapped = 0;
+}
+
+// Function to get an entry of the FAT
+// Arguments: 
+//     fs: The filesystem
+//     block: The block whose FAT entry to get
+// Returns: 
+//     The FAT entry for block (ie: the next block in the file, or 0xffff if block
+//     is the last block of its file)
+uint16_t getFatEntry(fileSystem *fs, int block) {
+    return fs -> fat[block];
+}
+
+// Function to set an entry of the FAT. The entry is only changed in memory, and
+// is written back to the filesystem file on the next call to syncFat
+// Arguments: 
+//     fs: The filesystem
+//     block: The block whose FAT entry to set
+//     value: The new value of the entry
+// Returns: 
+//     None
+void setFatEntry(fileSystem *fs, int block, uint16_t value) {
+    fs -> fat[block] = value;
+    fs -> fatDirty[(block * sizeof(uint16_t)) / fs -> blockSize] = 1;
+}
+
+// Function to write all modified FAT entries back to the filesystem file. 
+// Consecutive modified blocks of the FAT are written with a single write
+// Arguments: 
+//     fs: The filesystem whose FAT to write back
+// Returns: 
+//     0 on success, -1 on failure
+int syncFat(fileSystem *fs) {
+    int fatBlocks = fs -> fatSize / fs -> blockSize; // Number of blocks in the FAT
+    // Entries of a mapped FAT are modified in the image directly
+    if (fs -> fatMapped) {
+        memset(fs -> fatDirty, 0, fatBlocks);
+        return 0;
+    }
+
+    int blockSize = fs -> blockSize;
+    int i = 0;
+    while (i < fatBlocks) {
+        if (!(fs -> fatDirty[i])) {
+            i++;
+            continue;
+        }
+        // Find the run of dirty FAT blocks starting at block i
+        int start = i;
+        while (i < fatBlocks && fs -> fatDirty[i]) 
+            i++;
+
+        size_t len = (i - start) * blockSize;
+        if (imageWrite(fs, start * blockSize, (char*) fs -> fat + start * blockSize, len) != len) 
+            return -1;
+        memset(fs -> fatDirty + start, 0, i - start);
+    }
+
+    return 0;
+}
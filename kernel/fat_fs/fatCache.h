@@ -0,0 +1,13 @@
+#ifndef FAT_CACHE_H
+#define FAT_CACHE_H
+
+#include <stdint.h>
+#include "headers.h"
+
+int loadFat(fileSystem *fs);
+void unloadFat(fileSystem *fs);
+uint16_t getFatEntry(fileSystem *fs, int block);
+void setFatEntry(fileSystem *fs, int block, uint16_t value);
+int syncFat(fileSystem *fs);
+
+#endif
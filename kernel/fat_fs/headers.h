@@ -2,6 +2,8 @@
 #define HEADERS_H
 
 #include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
 
 typedef struct dirEntry {
     char name[32];
@@ -13,13 +15,12 @@ typedef struct dirEntry {
     char blank[16]; // 16 extra reserved bytes
 } dirEntry;
 
-// Definitions for bitmap entries
-#define FREE 0
-#define OCCUPIED 1
 // Definition for size of a directory entry
 #define DIR_ENTRY_SIZE sizeof(struct dirEntry)
 // Definition for size of the name field in a directory entry
 #define NAME_SIZE 32
+// Definition for the largest block size a filesystem can have
+#define MAX_BLOCK_SIZE 4096
 // Definitions for offsets to fields in a directory entry (from beginning of the entry)
 #define MTIME_OFFSET 40
 #define FIRST_BLOCK_OFFSET 36
@@ -44,4 +45,71 @@ typedef struct dirEntry {
 #define YYN 6
 #define YYY 7
 
+// Definition of struct for a handle on a file. Caches the location of the file's
+// directory entry and a position in its block chain, so that the file can be 
+// accessed without looking it up by name and so that moving forward through the
+// file follows each FAT entry only once
+typedef struct fileHandle {
+    off_t entryOffset; // Offset of the file's directory entry in the filesystem image
+    uint16_t firstBlock; // First block of the file
+    uint32_t cursorIndex; // Position of cursorBlock in the block chain (0 for the 
+                          // first block)
+    uint16_t cursorBlock; // Block the cursor is at
+    uint32_t cursorGeneration; // freeGeneration of the filesystem when the cursor 
+                               // was set. The cursor is only used if this matches
+} fileHandle;
+
+// Definition of struct for entries of the directory index. The directory index
+// maps the name of each file in the root directory to a handle on the file
+typedef struct indexEntry {
+    char name[NAME_SIZE + 1]; // Name of the file (null terminated)
+    fileHandle handle; // Handle on the file, used for accesses by name
+    struct indexEntry *next; // Next entry in the same bucket
+} indexEntry;
+
+// Definition of struct for the directory index, implemented as a hash table with
+// separate chaining. Also keeps track of where new directory entries can go
+typedef struct dirIndex {
+    indexEntry **buckets; // Array of buckets, each a list of entries
+    int numBuckets; // Number of buckets (always a power of 2)
+    int count; // Number of entries in the index
+    off_t *freeSlots; // Offsets of the slots of deleted entries (DEL_FILE_1), 
+                      // used as a stack
+    int numFreeSlots; // Number of offsets in freeSlots
+    int freeSlotsSize; // Number of offsets freeSlots has room for
+    off_t end; // Offset of the end of the directory (the entry whose name[0] is 
+               // DIR_END), or -1 if its last block has no room for one
+    int endBlock; // Block of the directory that holds its end (its last block if 
+                  // end is -1)
+} dirIndex;
+
+// Definition of struct for a mounted filesystem. Holds the state needed to access
+// one filesystem image, so that several images can be mounted at once. Created 
+// by mountImage and passed to every filesystem function
+typedef struct fileSystem {
+    char *name; // Name of the filesystem image on the host OS
+    int fd; // File descriptor of the image, opened once when it is mounted
+    char *map; // Pointer to the start of the mapped image if the image is mounted 
+               // with IMAGE_MMAP, NULL otherwise
+    off_t size; // Size of the image (in bytes)
+    int syncPolicy; // Durability policy applied at every sync point
+    int blockSize; // Size of blocks in the filesystem
+    int fatSize; // Size of FAT region of the filesystem
+    int numBlocks; // Number of blocks in the data region of the filesystem (the 
+                   // FAT has numBlocks+1 entries)
+    uint64_t *bitmap; // Packed bitmap of the free blocks in the filesystem. Bit 
+                      // (i - 1) is set iff block i is free
+    int bitmapWords; // Number of 64-bit words in bitmap
+    int freeHint; // Word of bitmap to start the next search for a free block at
+    int extentBlocks; // Number of contiguous blocks reserved at a time for a file
+                      // that grows (1 to add one block at a time)
+    uint16_t *fat; // In-memory copy of the FAT. Entry i is the entry for block i
+    char *fatDirty; // Dirty flags for the FAT, one per block of the FAT region
+    int fatMapped; // Whether fat points into the mapped image (1) or into a 
+                   // malloc'd copy (0)
+    dirIndex index; // Index of the files in the root directory by name
+    uint32_t freeGeneration; // Incremented whenever blocks are freed, which 
+                             // invalidates the cursors of all file handles
+} fileSystem;
+
 #endif
\ No newline at end of file
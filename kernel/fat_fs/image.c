@@ -0,0 +1,269 @@
+// Access to a filesystem image. The image is opened once when it is mounted, 
+// and is either accessed with pread/pwrite (IMAGE_FD) or mapped into memory in 
+// its entirety (IMAGE_MMAP), in which case directory entries and data blocks are
+// accessed directly through pointers into the mapping
+
+#define _GNU_SOURCE // For copy_file_range
+
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include "headers.h"
+#include "image.h"
+#include "mkfs.h"
+#include "fatCache.h"
+#include "dirIndex.h"
+#include "blockBitmap.h"
+
+// Function to check whether the geometry in the first entry of the FAT of an 
+// image is one mkfs creates, and whether the image is large enough to hold it
+// Arguments: 
+//     header: The first entry of the FAT (blocks in FAT, block size configuration)
+//     size: Size of the image (in bytes)
+// Returns: 
+//     1 if the geometry is valid, 0 otherwise
+static int validGeometry(uint8_t header[2], off_t size) {
+    if (header[0] == 0 || header[0] > 32 || header[1] > 4) return 0;
+    int blockSize = getBlockSize(header[1]);
+    int fatSize = blockSize * header[0];
+    int numBlocks = fatSize / 2 - 1;
+
+    return size >= fatSize + (off_t) blockSize * numBlocks;
+}
+
+// Function to check whether a filesystem image can be mounted, without mounting 
+// it. Used to tell an image that needs to be formatted (it is missing or was not
+// created by mkfs) from one that cannot be accessed, which must be left alone
+// Arguments: 
+//     fsName: Name of the filesystem image on the host OS
+// Returns: 
+//     IMAGE_VALID if the image was created by mkfs, IMAGE_MISSING if it does not 
+//     exist, IMAGE_INVALID if it exists but was not created by mkfs, and -1 if it
+//     cannot be opened or read (errno is set)
+int checkImage(char *fsName) {
+    int fd = open(fsName, O_RDONLY);
+    if (fd == -1) 
+        return (errno == ENOENT) ? IMAGE_MISSING : -1;
+
+    struct stat st;
+    uint8_t header[2];
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return -1;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        close(fd);
+        errno = S_ISDIR(st.st_mode) ? EISDIR : EINVAL;
+        return -1;
+    }
+    ssize_t ret = pread(fd, header, 2, 0);
+    close(fd);
+    if (ret == -1) return -1;
+
+    return (ret == 2 && validGeometry(header, st.st_size)) ? IMAGE_VALID : IMAGE_INVALID;
+}
+
+// Function to mount a filesystem image created by mkfs. Opens the image once, 
+// reads the geometry of the filesystem from the first entry of the FAT, loads 
+// the FAT, builds the bitmap of free blocks from the FAT, and indexes the root 
+// directory. In IMAGE_MMAP mode, the entire image is also mapped into memory
+// Arguments: 
+//     fsName: Name of the filesystem image on the host OS
+//     mode: The mode in which to mount the image (IMAGE_FD or IMAGE_MMAP)
+//     policy: The durability policy to apply at every sync point (SYNC_NONE, 
+//     SYNC_ASYNC or SYNC_FULL)
+// Returns: 
+//     A pointer to the mounted filesystem on success, NULL on failure (eg: the 
+//     image does not exist)
+fileSystem *mountImage(char *fsName, int mode, int policy) {
+    fileSystem *fs = calloc(1, sizeof(fileSystem));
+    fs -> name = malloc(strlen(fsName) + 1);
+    strcpy(fs -> name, fsName);
+    fs -> syncPolicy = policy;
+    fs -> extentBlocks = DEFAULT_EXTENT_BLOCKS;
+
+    fs -> fd = open(fsName, O_RDWR);
+    if (fs -> fd == -1) {
+        unmountImage(fs);
+        return NULL;
+    }
+
+    struct stat st;
+    uint8_t header[2]; // The first entry of the FAT (blocks in FAT, block size 
+                       // configuration)
+    if (fstat(fs -> fd, &st) == -1 || pread(fs -> fd, header, 2, 0) != 2) {
+        unmountImage(fs);
+        return NULL;
+    }
+    // Check that the image was created by mkfs
+    if (!validGeometry(header, st.st_size)) {
+        unmountImage(fs);
+        return NULL;
+    }
+    fs -> size = st.st_size;
+    fs -> blockSize = getBlockSize(header[1]);
+    fs -> fatSize = fs -> blockSize * header[0];
+    fs -> numBlocks = fs -> fatSize / 2 - 1;
+
+    if (mode == IMAGE_MMAP) {
+        fs -> map = mmap(NULL, fs -> size, PROT_READ | PROT_WRITE, MAP_SHARED, fs -> fd, 0);
+        if (fs -> map == MAP_FAILED) {
+            fs -> map = NULL;
+            unmountImage(fs);
+            return NULL;
+        }
+    }
+
+    if (loadFat(fs) == -1) {
+        unmountImage(fs);
+        return NULL;
+    }
+
+    // Build the bitmap of free blocks from the FAT
+    buildBitmap(fs);
+
+    // Index the files in the root directory
+    if (buildDirIndex(fs) == -1) {
+        unmountImage(fs);
+        return NULL;
+    }
+
+    return fs;
+}
+
+// Function to unmount a filesystem image. Writes back the FAT, flushes the 
+// mapping to disk, closes the image, and frees fs
+// Arguments: 
+//     fs: The filesystem to unmount
+// Returns: 
+//     None
+void unmountImage(fileSystem *fs) {
+    if (fs -> fat != NULL) 
+        syncFat(fs);
+    unloadFat(fs);
+    freeDirIndex(fs);
+    if (fs -> map != NULL) {
+        msync(fs -> map, fs -> size, MS_SYNC);
+        munmap(fs -> map, fs -> size);
+    }
+    if (fs -> fd != -1) 
+        close(fs -> fd);
+    freeBitmap(fs);
+    free(fs -> name);
+    free(fs);
+}
+
+// Function to read from a filesystem image
+// Arguments: 
+//     fs: The filesystem to read from
+//     offset: Offset in the image to read from
+//     buf: The buffer to put the read bytes in
+//     n: The number of bytes to read
+// Returns: 
+//     The number of bytes read, or -1 on error
+ssize_t imageRead(fileSystem *fs, off_t offset, void *buf, size_t n) {
+    if (fs -> map != NULL) {
+        if (offset + n > fs -> size) return -1;
+        memcpy(buf, fs -> map + offset, n);
+        return n;
+    }
+    return pread(fs -> fd, buf, n, offset);
+}
+
+// Function to write to a filesystem image
+// Arguments: 
+//     fs: The filesystem to write to
+//     offset: Offset in the image to write to
+//     buf: The buffer containing the bytes to write
+//     n: The number of bytes to write
+// Returns: 
+//     The number of bytes written, or -1 on error
+ssize_t imageWrite(fileSystem *fs, off_t offset, const void *buf, size_t n) {
+    if (fs -> map != NULL) {
+        if (offset + n > fs -> size) return -1;
+        memcpy(fs -> map + offset, buf, n);
+        return n;
+    }
+    return pwrite(fs -> fd, buf, n, offset);
+}
+
+// Function to copy bytes from a host file into a filesystem image with 
+// copy_file_range, so that they do not pass through a buffer. The bytes are read
+// from the current offset of the host file, which is advanced past them
+// Arguments: 
+//     fs: The filesystem to write to
+//     fd: File descriptor of the host file
+//     offset: Offset in the image to write to
+//     n: The number of bytes to copy
+// Returns: 
+//     The number of bytes copied, which is less than n if the host file ended, or 
+//     if the host OS cannot copy between the two files
+ssize_t imageCopyFrom(fileSystem *fs, int fd, off_t offset, size_t n) {
+    size_t copied = 0;
+    while (copied < n) {
+        off_t imageOffset = offset + copied;
+        ssize_t ret = copy_file_range(fd, NULL, fs -> fd, &imageOffset, n - copied, 0);
+        if (ret <= 0) break;
+        copied += ret;
+    }
+    return copied;
+}
+
+// Function to copy bytes from a filesystem image out to a host file with 
+// copy_file_range, so that they do not pass through a buffer. The bytes are 
+// written at the current offset of the host file, which is advanced past them
+// Arguments: 
+//     fs: The filesystem to read from
+//     fd: File descriptor of the host file
+//     offset: Offset in the image to read from
+//     n: The number of bytes to copy
+// Returns: 
+//     The number of bytes copied, which is less than n if the host OS cannot 
+//     copy between the two files
+ssize_t imageCopyTo(fileSystem *fs, int fd, off_t offset, size_t n) {
+    size_t copied = 0;
+    while (copied < n) {
+        off_t imageOffset = offset + copied;
+        ssize_t ret = copy_file_range(fs -> fd, &imageOffset, fd, NULL, n - copied, 0);
+        if (ret <= 0) break;
+        copied += ret;
+    }
+    return copied;
+}
+
+// Function to get a pointer to a location in a mapped filesystem image
+// Arguments: 
+//     fs: The filesystem
+//     offset: Offset in the image
+// Returns: 
+//     A pointer to the byte at offset if the image is mounted with IMAGE_MMAP, 
+//     NULL otherwise
+char *imageAddress(fileSystem *fs, off_t offset) {
+    if (fs -> map == NULL) return NULL;
+    return fs -> map + offset;
+}
+
+// Function to make changes to a filesystem image durable according to the 
+// durability policy the image was mounted with. Also writes back the FAT. 
+// Called at every sync point
+// Arguments: 
+//     fs: The filesystem to sync
+// Returns: 
+//     0 on success, -1 on failure
+int syncImage(fileSystem *fs) {
+    if (syncFat(fs) == -1) return -1;
+    if (fs -> syncPolicy == SYNC_NONE) return 0;
+
+    if (fs -> map != NULL) 
+        return msync(fs -> map, fs -> size, (fs -> syncPolicy == SYNC_FULL) ? MS_SYNC : MS_ASYNC);
+    if (fs -> syncPolicy == SYNC_FULL) 
+        return fdatasync(fs -> fd);
+
+    return 0;
+}
@@ -0,0 +1,35 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include "headers.h"
+
+// Definitions for the modes in which the filesystem image can be mounted
+#define IMAGE_FD 0 // Image is accessed with pread/pwrite on a file descriptor
+#define IMAGE_MMAP 1 // Image is mapped into memory once and accessed through 
+                     // pointers
+// Definitions for the durability policies applied at every sync point (f_close,
+// shell exit)
+#define SYNC_NONE 0 // Leave writeback to the host OS until the image is unmounted
+#define SYNC_ASYNC 1 // Schedule writeback of modified pages (msync MS_ASYNC)
+#define SYNC_FULL 2 // Wait until modified data is on disk (msync MS_SYNC/fdatasync)
+// Definitions for the results of checkImage
+#define IMAGE_VALID 0 // Image was created by mkfs
+#define IMAGE_MISSING 1 // Image does not exist
+#define IMAGE_INVALID 2 // Image exists but was not created by mkfs
+// Definition for the number of contiguous blocks reserved at a time for a file 
+// that grows, unless changed after mounting
+#define DEFAULT_EXTENT_BLOCKS 8
+
+int checkImage(char *fsName);
+fileSystem *mountImage(char *fsName, int mode, int policy);
+void unmountImage(fileSystem *fs);
+ssize_t imageRead(fileSystem *fs, off_t offset, void *buf, size_t n);
+ssize_t imageWrite(fileSystem *fs, off_t offset, const void *buf, size_t n);
+ssize_t imageCopyFrom(fileSystem *fs, int fd, off_t offset, size_t n);
+ssize_t imageCopyTo(fileSystem *fs, int fd, off_t offset, size_t n);
+char *imageAddress(fileSystem *fs, off_t offset);
+int syncImage(fileSystem *fs);
+
+#endif
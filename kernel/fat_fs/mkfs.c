@@ -3,71 +3,107 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <fcntl.h>
+#include <stdint.h>
 #include "headers.h"
+#include "mkfs.h"
 
-// Name of the filesystem
-char *fsName;
-// Bitmap for keeping track of free blocks in the filesystem
-char *bitmap;
-// Number of blocks in the data region of the filesystem (the FAT has numBlocks+1 entries)
-int numBlocks;
-// Size of FAT region of the filesystem
-int fatSize;
-// Size of blocks in the filesystem
-int blockSize;
-// Array to convert from integer to month name
-const char *months[12] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+// Size of the writes used to zero the data region with MKFS_ZERO (a multiple of
+// every block size)
+#define ZERO_CHUNK_SIZE (1 << 20)
 
-int mkfs(char *fs_Name, int blocksInFat, int blockSizeConfig, char *bitmapPointer) {
+// Function to get the block size for a block size configuration
+// Arguments: 
+//     blockSizeConfig: The block size configuration (0 to 4)
+// Returns: 
+//     The size of blocks (in bytes) for blockSizeConfig
+int getBlockSize(int blockSizeConfig) {
+    switch (blockSizeConfig) {
+        case 0: return 256;
+        case 1: return 512;
+        case 2: return 1024;
+        case 3: return 2048;
+        default: return 4096;
+    }
+}
+
+// Function to write zeros over a region of a file in chunks of ZERO_CHUNK_SIZE 
+// bytes
+// Arguments: 
+//     fd: File descriptor of the file
+//     start: Offset of the start of the region
+//     end: Offset of the end of the region
+// Returns: 
+//     0 on success, -1 on failure
+static int zeroRegion(int fd, off_t start, off_t end) {
+    char *zeros = calloc(1, ZERO_CHUNK_SIZE);
+    if (zeros == NULL) return -1;
+
+    for (off_t offset = start; offset < end; ) {
+        size_t n = (end - offset < ZERO_CHUNK_SIZE) ? end - offset : ZERO_CHUNK_SIZE;
+        ssize_t written = pwrite(fd, zeros, n, offset);
+        if (written <= 0) {
+            free(zeros);
+            return -1;
+        }
+        offset += written;
+    }
+
+    free(zeros);
+    return 0;
+}
+
+// Function to create a new filesystem image. Any existing file with the same name
+// is replaced. The image is created at its full size with ftruncate, so every 
+// byte that is not written reads back as 0, and only the first two FAT entries 
+// are written. With MKFS_SPARSE the host OS allocates the rest of the image as it
+// is used. With MKFS_ZERO the data region is also written with zeros in large 
+// block-aligned chunks, so that its storage is allocated up front. The image 
+// still needs to be mounted with mountImage before it can be used
+// Arguments: 
+//     fsName: Name of the filesystem image on the host OS
+//     blocksInFat: Number of blocks in the FAT region (1 to 32)
+//     blockSizeConfig: The block size configuration (0 to 4)
+//     mode: How to allocate the data region (MKFS_SPARSE or MKFS_ZERO)
+// Returns: 
+//     0 on success, -1 on failure (eg: invalid parameters)
+int mkfs(char *fsName, int blocksInFat, int blockSizeConfig, int mode) {
 
     // Check for valid parameters
     if (blockSizeConfig < 0 || blockSizeConfig > 4 || blocksInFat <= 0 || blocksInFat > 32)
         return -1;
-    
-    fsName = fs_Name;
 
-    int numEntries, fsSize;
-    switch (blockSizeConfig) {
-        case 0: blockSize = 256; break;
-        case 1: blockSize = 512; break;
-        case 2: blockSize = 1024; break;
-        case 3: blockSize = 2048; break;
-        default: blockSize = 4096;
-    }
+    int numEntries, numBlocks, fatSize;
+    off_t fsSize;
+    int blockSize = getBlockSize(blockSizeConfig);
 
     fatSize = blockSize * blocksInFat; // Size of FAT
     numEntries = (int) (fatSize / 2); // Number of entries in FAT
     numBlocks = numEntries - 1;
-    fsSize = fatSize + blockSize * numBlocks; // Total size of filesystem file
+    fsSize = fatSize + (off_t) blockSize * numBlocks; // Total size of filesystem file
 
-    // Create new file for filesystem and fill with 0's, except for first two FAT entries
-    char buffer[4];
-    int fd = open(fsName, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+    // Create new file for filesystem, all 0's
+    int fd = open(fsName, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd == -1) return -1;
+    if (ftruncate(fd, fsSize) == -1) {
+        close(fd);
+        return -1;
+    }
 
     // Write first entry of FAT
-    buffer[0] = (char) blocksInFat;
-    buffer[1] = (char) blockSizeConfig;
-    // Write second entry of FAT
-    buffer[2] = buffer[3] = (char) 255;
-    write(fd, buffer, 4);
-
-    buffer[0] = 0;
-    for (int i = 0; i < fsSize - 4; i++) {
-        write(fd, buffer, 1);
+    uint8_t header[4];
+    header[0] = (uint8_t) blocksInFat;
+    header[1] = (uint8_t) blockSizeConfig;
+    // Write second entry of FAT (the root directory is a single block)
+    header[2] = header[3] = 0xff;
+    if (pwrite(fd, header, 4, 0) != 4) {
+        close(fd);
+        return -1;
     }
 
-    // Create bitmap to keep track of free space (implemented as char arr)
-    bitmap = malloc((numEntries - 1) * sizeof(char));
-    // Initialize bitmap
-    for (int i = 0; i < numEntries - 1; i++)
-        bitmap[i] = FREE;
+    if (mode == MKFS_ZERO && zeroRegion(fd, fatSize, fsSize) == -1) {
+        close(fd);
+        return -1;
+    }
 
-    // Mark block 1 as occupied (it is occupied by the root directory)
-    bitmap[0] = OCCUPIED;
-    bitmapPointer = bitmap;
-    
-    return 0;
+    return close(fd);
 }
-
-// TODO:
-// 1. ADD ALL ERROR CHECKING
\ No newline at end of file
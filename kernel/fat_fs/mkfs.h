@@ -1,6 +1,12 @@
 #ifndef MKFS_H
 #define MKFS_H
 
-int mkfs(char *fs_Name, int blocksInFat, int blockSizeConfig, char *bitmapPointer);
+// Definitions for how mkfs allocates the data region of a new image
+#define MKFS_SPARSE 0 // Leave the data region sparse, allocated by the host OS 
+                      // as blocks are written
+#define MKFS_ZERO 1 // Write zeros over the data region up front
 
-#endif
\ No newline at end of file
+int getBlockSize(int blockSizeConfig);
+int mkfs(char *fsName, int blocksInFat, int blockSizeConfig, int mode);
+
+#endif
@@ -7,338 +7,749 @@
 #include <time.h>
 #include <fcntl.h>
 #include "headers.h"
+#include "fatCache.h"
+#include "image.h"
+#include "dirIndex.h"
+#include "blockBitmap.h"
 #include "../userFunctions.h"
 
-// Name of the filesystem
-extern char *fsName;
-// Bitmap for keeping track of free blocks in the filesystem
-char *bitmap;
-// Number of blocks in the data region of the filesystem (the FAT has numBlocks+1 entries)
-extern int numBlocks;
-// Size of FAT region of the filesystem
-extern int fatSize;
-// Size of blocks in the filesystem
-extern int blockSize;
 // Array to convert from integer to month name
-extern const char *months[12];
-
-// Function to find the first free block in the data region of the filesystem. 
-// Arguments: 
-//     
-// Returns: 
-//     -1 on error (eg: there are no free blocks), or the number of the first free 
-//     block otherwise
-int findFreeBlock() {
-    for (int i = 0; i < numBlocks; i++) {
-        // Block 0xffff is invalid
-        if (i == 0xffff - 1) continue;
-        if (bitmap[i] == FREE) 
-            return i + 1;
-    }
-    return -1;
-}
-
-// Function to add another block to a file
+const char *months[12] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+// Definitions for the targets that writeMappedFile can write to
+#define TO_FAT_FILE 0 // A file in the FAT filesystem
+#define TO_HOST_FILE 1 // A host OS file descriptor
+#define TO_FD 2 // A file descriptor of the calling process
+// Definition for the size of the chunks cp copies files in (a multiple of every 
+// block size)
+#define CP_CHUNK_SIZE (64 * 1024)
+// Definitions for the size of the buffer ls formats its output in, and the longest
+// line ls can print for a file
+#define LS_BUFFER_SIZE 4096
+#define LS_MAX_LINE 128
+
+// Function to add another block to a file. The block right after lastBlock is 
+// used if it is free, so that the file stays contiguous. Otherwise, the block is
+// taken from the start of a run of free blocks long enough for an extent, if 
+// there is one, so that the file can keep growing contiguously from there
 // Arguments: 
+//     fs: The filesystem
 //     lastBlock: Number of the last block of the file being extended. If lastBlock
 //      is -1, the function will allocate the new block as the first block in 
 //      a file
 // Returns: 
 //     -1 on error (eg: there are no free blocks), or the number of the new block 
 //     otherwise
-int addBlock(int lastBlock) {
-    int newBlock = findFreeBlock();
+int addBlock(fileSystem *fs, int lastBlock) {
+    int newBlock = -1;
+    if (lastBlock > 0 && lastBlock < fs -> numBlocks && isBlockFree(fs, lastBlock + 1))
+        newBlock = lastBlock + 1;
+    else if (lastBlock > 0 && fs -> extentBlocks > 1)
+        newBlock = findFreeRun(fs, fs -> extentBlocks);
+    if (newBlock == -1)
+        newBlock = findFreeBlock(fs);
     // There are no free blocks
     if (newBlock == -1)
         return -1;
 
-    // Set the new entries in the FAT
-    uint16_t entry1 = newBlock;
-    uint16_t entry2 = 0xffff;
+    // Set entry for lastBlock in FAT
+    if (lastBlock > 0)
+        setFatEntry(fs, lastBlock, newBlock);
+
+    // Set entry for newBlock in FAT
+    setFatEntry(fs, newBlock, 0xffff);
 
-    int fd = open(fsName, O_RDWR);
+    // Mark newBlock as occupied 
+    markBlockUsed(fs, newBlock);
+
+    return newBlock;
+}
 
-    // Write entry for lastBlock in FAT
-    if (lastBlock > 0) {
-        lseek(fd, lastBlock * 2, SEEK_SET);
-        write(fd, &entry1, sizeof(uint16_t));
+// Function to add an extent of up to fs -> extentBlocks contiguous blocks to the
+// end of a file. Blocks past the end of the file stay reserved for it until it is
+// trimmed with trimFile, so files that grow at the same time do not interleave
+// their blocks. The extent is cut short at the first block that is in use
+// Arguments: 
+//     fs: The filesystem
+//     lastBlock: Number of the last block of the file being extended
+// Returns: 
+//     -1 on error (eg: there are no free blocks), or the number of the first 
+//     block of the extent otherwise
+static int addExtent(fileSystem *fs, int lastBlock) {
+    int firstBlock = addBlock(fs, lastBlock);
+    if (firstBlock == -1) return -1;
+
+    int currBlock = firstBlock;
+    for (int i = 1; i < fs -> extentBlocks; i++) {
+        if (currBlock >= fs -> numBlocks || !isBlockFree(fs, currBlock + 1)) break;
+        currBlock = addBlock(fs, currBlock);
     }
 
-    // Write entry for newBlock in FAT
-    lseek(fd, newBlock * 2, SEEK_SET);
-    write(fd, &entry2, sizeof(uint16_t));
+    return firstBlock;
+}
 
-    close(fd);
+// Function to find slots in the root directory for new directory entries. Slots 
+// of deleted entries are taken from the free slots in the directory index first, 
+// and the rest are taken from the end of the directory, in which case blocks are
+// added to the directory as needed and the end of the directory is moved past the
+// new slots. The directory itself is not scanned
+// Arguments: 
+//     fs: The filesystem
+//     count: Number of slots to find
+//     slots: Array of length count to put the offsets of the slots in
+// Returns: 
+//     0 on success, -1 if there are no free blocks left to extend the directory 
+//     with (in which case no slots are taken)
+static int allocateDirSlots(fileSystem *fs, int count, off_t *slots) {
+    int found = 0; // Number of slots found so far
+    while (found < count && fs -> index.numFreeSlots > 0) 
+        slots[found++] = takeFreeSlot(fs);
+    if (found == count) return 0;
+    int numReused = found; // Number of slots taken from the free slots
+
+    // Take the rest of the slots from the end of the directory. When the last 
+    // slot taken fills its block, the directory has no end marker (like a 
+    // directory whose last block is full), so no block is added just to hold one
+    int currBlock = fs -> index.endBlock; // Block of the directory we are at
+    int currLoc = fs -> blockSize; // Location in the current block (in bytes)
+    off_t blockStart = fs -> fatSize + (off_t) (currBlock - 1) * fs -> blockSize;
+    if (fs -> index.end != -1) 
+        currLoc = fs -> index.end - blockStart;
+    while (1) {
+        if (found == count) break;
+        if (currLoc + DIR_ENTRY_SIZE > fs -> blockSize) {
+            // Go to the next block of the directory, adding one if there is none
+            uint16_t nextBlock = getFatEntry(fs, currBlock);
+            currBlock = (nextBlock == 0xffff) ? addBlock(fs, currBlock) : nextBlock;
+            if (currBlock == -1) {
+                // Put back the free slots that were taken
+                for (int i = numReused - 1; i >= 0; i--) 
+                    addFreeSlot(fs, slots[i]);
+                return -1;
+            }
+            blockStart = fs -> fatSize + (off_t) (currBlock - 1) * fs -> blockSize;
+            currLoc = 0;
+        }
+        slots[found++] = blockStart + currLoc;
+        currLoc += DIR_ENTRY_SIZE;
+    }
 
-    // Mark newBlock as occupied 
-    bitmap[newBlock - 1] = OCCUPIED;
+    // If the last slot taken filled its block, the end marker goes at the start 
+    // of the next block of the directory, if there is one (eg: one added by an 
+    // earlier call that failed)
+    if (currLoc + DIR_ENTRY_SIZE > fs -> blockSize) {
+        uint16_t nextBlock = getFatEntry(fs, currBlock);
+        if (nextBlock == 0xffff) {
+            fs -> index.end = -1;
+            fs -> index.endBlock = currBlock;
+            return 0;
+        }
+        currBlock = nextBlock;
+        blockStart = fs -> fatSize + (off_t) (currBlock - 1) * fs -> blockSize;
+        currLoc = 0;
+    }
+    char end = DIR_END;
+    imageWrite(fs, blockStart + currLoc, &end, 1);
+    fs -> index.end = blockStart + currLoc;
+    fs -> index.endBlock = currBlock;
 
-    return newBlock;
+    return 0;
 }
 
+// Function to create directory entries for several files at once. Entries in 
+// adjacent slots are written with a single write. Assumes the names are valid 
+// and distinct, and that none of the files exist
+// Arguments: 
+//     fs: The filesystem
+//     fileNames: Names of the files
+//     numFiles: Length of fileNames
+//     type: Type of the files
+//     perm: File permissions
+// Returns: 
+//     -1 on failure (eg: there are not enough free blocks for all the files, in 
+//     which case only some of them are created), 0 on success
+static int createNewFiles(fileSystem *fs, char **fileNames, int numFiles, uint8_t type, uint8_t perm) {
+    dirEntry *entries = calloc(numFiles, DIR_ENTRY_SIZE);
+    off_t *slots = malloc(numFiles * sizeof(off_t));
+
+    // Allocate the first block of each file in the data region of the 
+    // filesystem, and create its directory entry
+    time_t currTime = time(NULL);
+    int numCreated = 0;
+    for (; numCreated < numFiles; numCreated++) {
+        int firstBlock = addBlock(fs, -1);
+        if (firstBlock == -1) break;
+        dirEntry *entry = &(entries[numCreated]);
+        strncpy(entry -> name, fileNames[numCreated], NAME_SIZE);
+        entry -> size = 0;
+        entry -> firstBlock = (uint16_t) firstBlock;
+        entry -> type = type;
+        entry -> perm = perm;
+        entry -> mtime = currTime;
+    }
+
+    // Write the entries to the directory and add them to the directory index
+    int ret = (numCreated < numFiles) ? -1 : 0;
+    if (allocateDirSlots(fs, numCreated, slots) == -1) {
+        // Free the blocks of the files that could not be created
+        for (int i = 0; i < numCreated; i++) {
+            setFatEntry(fs, entries[i].firstBlock, 0);
+            markBlockFree(fs, entries[i].firstBlock);
+        }
+        numCreated = 0;
+        ret = -1;
+    }
+    for (int i = 0; i < numCreated; ) {
+        int run = 1; // Number of entries with adjacent slots starting at entry i
+        while (i + run < numCreated && slots[i + run] == slots[i] + run * (off_t) DIR_ENTRY_SIZE) 
+            run++;
+        imageWrite(fs, slots[i], &(entries[i]), run * DIR_ENTRY_SIZE);
+        for (int j = i; j < i + run; j++) 
+            addToDirIndex(fs, fileNames[j], slots[j], entries[j].firstBlock);
+        i += run;
+    }
+
+    free(entries);
+    free(slots);
+    return ret;
+}
 
 // Function to create new directory entry for a file. Assumes the file does not
 // exist
 // Arguments: 
+//     fs: The filesystem
 //     fileName: Name of file
 //     type: Type of the file
 //     perm: File permissions
 // Returns: 
 //     -1 on failure, 0 on success
-int createNewFile(char *fileName, uint8_t type, uint8_t perm) {
+int createNewFile(fileSystem *fs, char *fileName, uint8_t type, uint8_t perm) {
     // Check if fileName is valid. ALSO NEED TO CHECK IF THE ACTUAL NAME IS VALID
-    if (strlen(fileName) > 32)
+    if (strlen(fileName) > NAME_SIZE)
         return -1;
 
-    // Allocate first block of file in the data region of the filesystem
-    int firstBlock = addBlock(-1);
-
-    int fd = open(fsName, O_RDWR);
-
-    // Create the directory entry 
-    dirEntry entry;
-    strcpy(entry.name, fileName);
-    entry.size = 0;
-    entry.firstBlock = (uint16_t) firstBlock;
-    entry.type = type;
-    entry.perm = perm;
-    entry.mtime = time(NULL);
-
-    // Go through all the entries of the root directory, checking if there is a 
-    // deleted entry to replace. If not, check if there is space in the last block
-    // of the directory to add a new entry. Otherwise, add a new block to the 
-    // directory and add a new entry there
-    int currBlock = 1; // Current block we are at in the directory
-    int currLoc = 0; // Current location in the current block (in bytes)
-    int created = 0; // Boolean to identify whether the directory entry has been 
-                     // created yet
-    while (currBlock != 0xffff) {
-        while (currLoc < blockSize) {
-            // seek to beginning of current directory entry
-            lseek(fd, fatSize + (currBlock - 1) * blockSize + currLoc, SEEK_SET);
-            // Inspect first byte of the directory entry
-            char id;
-            read(fd, &id, 1);
-
-            // If we are at a deleted entry or the end of the directory, we can 
-            // create the new directory entry here
-            if (id == 0 || id == 1) {
-                lseek(fd, fatSize + (currBlock - 1) * blockSize + currLoc, SEEK_SET);
-                // Write the directory entry
-                write(fd, &entry, DIR_ENTRY_SIZE);
-                // Reset end of directory if we overwrote previous end of directory
-                if (id == 0) {
-                    // If we are at the end of the block, we need to add a new block
-                    // to the directory
-                    if (currLoc + DIR_ENTRY_SIZE >= blockSize) {
-                        currBlock = addBlock(currBlock);
-                        if (currBlock == -1) {
-                            close(fd);
-                            return -1;
-                        }
-                        // Seek to beginning of new block
-                        lseek(fd, fatSize + (currBlock - 1) * blockSize, SEEK_SET);
-                        // Write 0 to first byte of the new block
-                        write(fd, &id, 1);
-                    } else {
-                        write(fd, &id, 1);
-                    }
-                }
-                created = 1;
-            }
-
-            if (created) break;
-            currLoc += DIR_ENTRY_SIZE;
-        }
-        if (created) break;
-        // Get next block in the directory from FAT
-        lseek(fd, currBlock * 2, SEEK_SET);
-        uint16_t nextBlock;
-        read(fd, &nextBlock, sizeof(uint16_t));
-        // If there are no more blocks in the file, we need to add a block
-        if (nextBlock == (uint16_t) 0xfff) {
-            currBlock = addBlock(currBlock);
-        } else {
-            currBlock = nextBlock;
-        }
-
-        if (currBlock == -1) {
-            close(fd);
-            return -1;
-        }
-        currLoc = 0;
-    }
-
-    close(fd);
-
-    return 0;
+    return createNewFiles(fs, &fileName, 1, type, perm);
 }
 
-// Function to find a file in the root directory
+// Function to find a file in the root directory. The file is looked up in the 
+// directory index, so the directory itself is not scanned
 // Arguments: 
+//     fs: The filesystem
 //     fileName: Name of the file to be found
 // Returns: 
 //     -1 if file not found, otherwise returns the offset that we need to seek to 
 //     in the filesystem file to get to the beginning of the fileName's directory 
 //     entry 
-off_t findFile(char *fileName) {
-    int currBlock = 1; // Current block we are at in the directory
-    int currLoc = 0; // Current location in the current block (in bytes)
-
-    int fd = open(fsName, O_RDWR);
-
-    while (currBlock != 0xffff) {
-        while (currLoc < blockSize) {
-            // seek to beginning of current directory entry
-            lseek(fd, fatSize + (currBlock - 1) * blockSize + currLoc, SEEK_SET);
-            char name[32];
-            // Read the name of the file of the current entry
-            read(fd, name, 32);
-            if (strcmp(name, fileName) == 0) {
-                close(fd);
-                return fatSize + (currBlock - 1) * blockSize + currLoc;
-            }
-            currLoc += DIR_ENTRY_SIZE;
-        }
-        lseek(fd, currBlock * 2, SEEK_SET);
-        uint16_t nextBlock;
-        read(fd, &nextBlock, sizeof(uint16_t));
-        currBlock = nextBlock;
-        currLoc = 0;
-    }
+off_t findFile(fileSystem *fs, char *fileName) {
+    indexEntry *entry = lookupDirIndex(fs, fileName);
+    if (entry == NULL) return -1;
 
-    close(fd);
-
-    return -1;
+    return entry -> handle.entryOffset;
 }
 
 // Function to touch files. If the file already exists, update its mtime in its 
-// directory entry. Otherwise, create the file. 
+// directory entry. Otherwise, create the file. All of the files that need to be
+// created are created together, with a single pass over the directory
 // Arguments: 
+//     fs: The filesystem
 //     fileNames: Array of strings that are the names of the files to be touched
 //     numFiles: Length of fileNames
 // Returns: 
 //     -1 on failure (eg: there is not enough space to create all the files), and 0 
 //     otherwise
-int touch(char **fileNames, int numFiles) {
-
-    int fd = open(fsName, O_RDWR);
+int touch(fileSystem *fs, char **fileNames, int numFiles) {
+    char **newNames = malloc(numFiles * sizeof(char*)); // Names of the files to create
+    int numNew = 0;
+    int ret = 0;
 
+    time_t currTime = time(NULL);
     for (int i = 0; i < numFiles; i++) {
-        off_t offset = findFile(fileNames[i]);
-        if (offset == -1) { // If file does not exist, create it. By default,
-                            // make it a regular file with YYN permissions
-            if (createNewFile(fileNames[i], REG_FILE, YYN) == -1) {
-                close(fd);
-                return -1;
-            }
-        } else { // If file does exist, update its mtime
-            // Seek to the location of mtime in the file's directory entry
-            lseek(fd, offset + MTIME_OFFSET, SEEK_SET);
-            time_t currTime = time(NULL);
-            // Update the directory entry's time
-            write(fd, &currTime, sizeof(time_t));
+        off_t offset = findFile(fs, fileNames[i]);
+        if (offset != -1) { // If file does exist, update its mtime
+            imageWrite(fs, offset + MTIME_OFFSET, &currTime, sizeof(time_t));
+            continue;
+        }
+        if (strlen(fileNames[i]) > NAME_SIZE) { // The name is too long
+            ret = -1;
+            continue;
         }
+        // Each file is only created once, even if it is named more than once
+        int duplicate = 0;
+        for (int j = 0; j < numNew && !duplicate; j++) 
+            duplicate = (strcmp(newNames[j], fileNames[i]) == 0);
+        if (!duplicate) 
+            newNames[numNew++] = fileNames[i];
     }
 
-    close(fd);
+    // Create the files that do not exist. By default, make them regular files with 
+    // YYN permissions
+    if (numNew > 0 && createNewFiles(fs, newNames, numNew, REG_FILE, YYN) == -1) 
+        ret = -1;
 
-    return 0;
+    free(newNames);
+    return ret;
 }
 
-// Function to delete the specified file
+// Function to free a chain of blocks by setting them to free in the bitmap and 
+// setting their entries in the FAT to 0. Invalidates the cursors of all file 
+// handles, since they may point into the freed blocks
 // Arguments: 
-//     fileName: Name of file to delete
+//     fs: The filesystem
+//     firstBlock: First block of the chain to free
 // Returns: 
-//     0 on success, -1 otherwise (eg: file does not exist)
-int deleteFile(char *fileName) {
-    off_t offset = findFile(fileName);
-    if (offset == -1) return -1; // File does not exist
-
-    // Get the first block of the file
-    int fd = open(fsName, O_RDWR);
-    lseek(fd, offset + FIRST_BLOCK_OFFSET, SEEK_SET);
-    uint16_t firstBlock;
-    read(fd, &firstBlock, sizeof(uint16_t));
-
-    // Delete file's directory entry by setting name[0] in its directory entry to 1
-    lseek(fd, offset, SEEK_SET);
-    char buffer = 1;
-    write(fd, &buffer, sizeof(char));
-
-    // Free all of the file's blocks in the data region by setting them to free in
-    // the bitmap and setting the blocks to 0 in the FAT
+//     None
+static void freeChain(fileSystem *fs, int firstBlock) {
     int currBlock = firstBlock;
     while (currBlock != 0xffff) {
-        bitmap[currBlock - 1] = FREE; // currBlock is index currBlock - 1 in bitmap
+        markBlockFree(fs, currBlock);
         // Get next block in the file
-        lseek(fd, currBlock * 2, SEEK_SET);
-        uint16_t nextBlock;
-        read(fd, &nextBlock, sizeof(uint16_t));
+        uint16_t nextBlock = getFatEntry(fs, currBlock);
         // Set the current block to 0 in the FAT
-        lseek(fd, currBlock * 2, SEEK_SET);
-        uint16_t zero = 0;
-        write(fd, &zero, sizeof(uint16_t));
+        setFatEntry(fs, currBlock, 0);
         // Go to next block in the file
         currBlock = nextBlock;
     } 
+    fs -> freeGeneration += 1;
+}
+
+// Function to get a handle on a file, so that the file can be read and written 
+// without looking it up by name again
+// Arguments: 
+//     fs: The filesystem
+//     fileName: Name of the file
+//     handle: Pointer to the handle to fill in
+// Returns: 
+//     0 on success, -1 if fileName does not exist
+int openFileHandle(fileSystem *fs, char *fileName, fileHandle *handle) {
+    indexEntry *entry = lookupDirIndex(fs, fileName);
+    if (entry == NULL) return -1;
+
+    *handle = entry -> handle;
+
+    return 0;
+}
+
+// Function to remove a file's name from the root directory without freeing its 
+// blocks, for files that are still open. The directory entry is marked as 
+// DEL_FILE_2, so it is not reused until releaseFile is called on the file
+// Arguments: 
+//     fs: The filesystem
+//     fileName: Name of file to unlink
+// Returns: 
+//     0 on success, -1 otherwise (eg: file does not exist)
+int unlinkFile(fileSystem *fs, char *fileName) {
+    indexEntry *entry = lookupDirIndex(fs, fileName);
+    if (entry == NULL) return -1; // File does not exist
+
+    char buffer = DEL_FILE_2;
+    imageWrite(fs, entry -> handle.entryOffset, &buffer, sizeof(char));
+    removeFromDirIndex(fs, fileName);
+
+    return 0;
+}
+
+// Function to free the directory entry and blocks of a file that has been 
+// unlinked with unlinkFile
+// Arguments: 
+//     fs: The filesystem
+//     handle: Handle on the unlinked file
+// Returns: 
+//     None
+void releaseFile(fileSystem *fs, fileHandle *handle) {
+    // Mark the directory entry as deleted so that it can be reused
+    char buffer = DEL_FILE_1;
+    imageWrite(fs, handle -> entryOffset, &buffer, sizeof(char));
+    addFreeSlot(fs, handle -> entryOffset);
+    // Free all of the file's blocks in the data region
+    freeChain(fs, handle -> firstBlock);
+}
+
+// Function to delete the specified file
+// Arguments: 
+//     fs: The filesystem
+//     fileName: Name of file to delete
+// Returns: 
+//     0 on success, -1 otherwise (eg: file does not exist)
+int deleteFile(fileSystem *fs, char *fileName) {
+    fileHandle handle;
+    if (openFileHandle(fs, fileName, &handle) == -1) return -1; // File does not exist
 
-    close(fd);
+    // Remove the file from the directory, then free its directory entry and blocks
+    unlinkFile(fs, fileName);
+    releaseFile(fs, &handle);
 
     return 0;
 }
 
-// Function to read a file on the FAT filesystem. 
+// Function to compact the root directory once most of its slots hold deleted 
+// entries (at least a block's worth, and more than there are files). The entries
+// still in use are moved to the front of the directory, in order, and the blocks
+// of the directory past its new end are freed. Entries of files that were 
+// unlinked while open are moved too
+// Arguments: 
+//     fs: The filesystem
+//     entryMoved: Function called with the old and new offsets of each moved 
+//                 entry, so that handles on the file kept outside the filesystem 
+//                 can be updated (may be NULL)
+// Returns: 
+//     1 if the directory was compacted, 0 otherwise
+int compactDirectory(fileSystem *fs, void (*entryMoved)(off_t oldOffset, off_t newOffset)) {
+    int slotsPerBlock = fs -> blockSize / DIR_ENTRY_SIZE;
+    if (fs -> index.numFreeSlots < slotsPerBlock || fs -> index.numFreeSlots <= fs -> index.count) 
+        return 0;
+
+    char block[MAX_BLOCK_SIZE];
+    int readBlock = 1; // Block of the directory entries are moved from
+    int writeBlock = 1; // Block of the directory entries are moved to
+    int writeLoc = 0; // Location in writeBlock entries are moved to (in bytes)
+    int endReached = 0;
+    while (readBlock != 0xffff && !endReached) {
+        off_t readStart = fs -> fatSize + (off_t) (readBlock - 1) * fs -> blockSize;
+        imageRead(fs, readStart, block, fs -> blockSize);
+        for (int readLoc = 0; readLoc < fs -> blockSize; readLoc += DIR_ENTRY_SIZE) {
+            dirEntry *entry = (dirEntry*)(block + readLoc);
+            if (entry -> name[0] == DIR_END) {
+                endReached = 1;
+                break;
+            }
+            if (entry -> name[0] == DEL_FILE_1) continue;
+
+            off_t oldOffset = readStart + readLoc;
+            off_t newOffset = fs -> fatSize + (off_t) (writeBlock - 1) * fs -> blockSize + writeLoc;
+            if (newOffset != oldOffset) {
+                // Write the entry to its new slot before marking its old slot as
+                // deleted, so that it is never missing from the directory
+                imageWrite(fs, newOffset, entry, DIR_ENTRY_SIZE);
+                char deleted = DEL_FILE_1;
+                imageWrite(fs, oldOffset, &deleted, 1);
+                if (entry -> name[0] != DEL_FILE_2) {
+                    char name[NAME_SIZE + 1];
+                    strncpy(name, entry -> name, NAME_SIZE);
+                    name[NAME_SIZE] = '\0';
+                    lookupDirIndex(fs, name) -> handle.entryOffset = newOffset;
+                }
+                if (entryMoved != NULL) 
+                    entryMoved(oldOffset, newOffset);
+            }
+            writeLoc += DIR_ENTRY_SIZE;
+            if (writeLoc == fs -> blockSize) {
+                writeBlock = getFatEntry(fs, writeBlock);
+                writeLoc = 0;
+            }
+        }
+        readBlock = getFatEntry(fs, readBlock);
+    }
+    // Every slot of the directory is in use
+    if (writeBlock == 0xffff) return 0;
+
+    // Move the end of the directory and free the blocks after it
+    off_t end = fs -> fatSize + (off_t) (writeBlock - 1) * fs -> blockSize + writeLoc;
+    char endMarker = DIR_END;
+    imageWrite(fs, end, &endMarker, 1);
+    uint16_t nextBlock = getFatEntry(fs, writeBlock);
+    if (nextBlock != 0xffff) {
+        setFatEntry(fs, writeBlock, 0xffff);
+        freeChain(fs, nextBlock);
+    }
+    fs -> index.end = end;
+    fs -> index.endBlock = writeBlock;
+    fs -> index.numFreeSlots = 0;
+
+    return 1;
+}
+
+// Function to get the size of the file a handle is on. The size is read from the
+// file's directory entry
+// Arguments: 
+//     fs: The filesystem
+//     handle: Handle on the file
+// Returns: 
+//     The size of the file 
+uint32_t getHandleSize(fileSystem *fs, fileHandle *handle) {
+    uint32_t size;
+    imageRead(fs, handle -> entryOffset + SIZE_OFFSET, &size, sizeof(uint32_t));
+
+    return size;
+}
+
+// Function to count how many blocks of a chain, starting at a given block, are 
+// stored one after the other in the image, so that they can be read or written 
+// with a single call
 // Arguments: 
+//     fs: The filesystem
+//     block: The block to start at
+//     maxBlocks: The most blocks to count
+// Returns: 
+//     The number of contiguous blocks (at least 1)
+static uint32_t contiguousBlocks(fileSystem *fs, int block, uint32_t maxBlocks) {
+    uint32_t count = 1;
+    while (count < maxBlocks && getFatEntry(fs, block) == block + 1) {
+        block++;
+        count++;
+    }
+
+    return count;
+}
+
+// Function to find the block at a given position in a file's block chain. The 
+// search starts from the handle's cursor if the cursor is still valid and not past
+// the wanted block, and the cursor is moved to the block found
+// Arguments: 
+//     fs: The filesystem
+//     handle: Handle on the file
+//     blockIndex: Position of the wanted block in the chain (0 for the first block)
+//     extend: If nonzero, blocks are added to the end of the file until the chain
+//             reaches blockIndex
+// Returns: 
+//     The number of the block, or -1 if the chain is too short (and extend is 0,
+//     or there are no free blocks left to extend it with)
+static int findBlockAt(fileSystem *fs, fileHandle *handle, uint32_t blockIndex, int extend) {
+    uint32_t currIndex = 0;
+    int currBlock = handle -> firstBlock;
+    if (handle -> cursorGeneration == fs -> freeGeneration && 
+            handle -> cursorIndex <= blockIndex) {
+        currIndex = handle -> cursorIndex;
+        currBlock = handle -> cursorBlock;
+    }
+
+    while (currIndex < blockIndex) {
+        int nextBlock = getFatEntry(fs, currBlock);
+        if (nextBlock == 0xffff) { // We have reached the end of the file
+            if (!extend) break;
+            nextBlock = addExtent(fs, currBlock);
+            if (nextBlock == -1) break;
+        }
+        currBlock = nextBlock;
+        currIndex++;
+    }
+
+    // Move the cursor to the furthest block reached
+    handle -> cursorIndex = currIndex;
+    handle -> cursorBlock = currBlock;
+    handle -> cursorGeneration = fs -> freeGeneration;
+
+    return (currIndex == blockIndex) ? currBlock : -1;
+}
+
+// Function to find where a range of a file is stored in the image. Only the part
+// of the range up to the first break in the contiguity of its blocks is found
+// Arguments: 
+//     fs: The filesystem
+//     handle: Handle on the file
+//     offset: Offset in the file at which the range starts
+//     n: Length of the range
+//     extend: If nonzero, blocks are added to the end of the file until the chain
+//             reaches offset
+//     imageOffset: Pointer to the variable to set to the offset in the image that
+//                  the range starts at
+// Returns: 
+//     The length of the part of the range that is stored contiguously from 
+//     *imageOffset (at most n), or 0 if the chain does not reach offset
+static uint32_t locateRange(fileSystem *fs, fileHandle *handle, uint32_t offset, uint32_t n, 
+        int extend, off_t *imageOffset) {
+    uint32_t blockOffset = offset % fs -> blockSize; // Offset within the block
+    int currBlock = findBlockAt(fs, handle, offset / fs -> blockSize, extend);
+    if (currBlock == -1) return 0;
+
+    uint32_t numBlocks = (blockOffset + n + fs -> blockSize - 1) / fs -> blockSize;
+    uint32_t length = contiguousBlocks(fs, currBlock, numBlocks) * fs -> blockSize - blockOffset;
+    *imageOffset = fs -> fatSize + (off_t) (currBlock - 1) * fs -> blockSize + blockOffset;
+
+    return (length < n) ? length : n;
+}
+
+// Function to update the directory entry of a file after part of it was written.
+// Sets the size if the file grew, and sets the mtime
+// Arguments: 
+//     fs: The filesystem
+//     handle: Handle on the file
+//     end: Offset in the file of the end of the written part
+// Returns: 
+//     None
+static void updateWrittenEntry(fileSystem *fs, fileHandle *handle, uint32_t end) {
+    if (end > getHandleSize(fs, handle)) 
+        imageWrite(fs, handle -> entryOffset + SIZE_OFFSET, &end, sizeof(uint32_t));
+    time_t newTime = time(NULL);
+    imageWrite(fs, handle -> entryOffset + MTIME_OFFSET, &newTime, sizeof(time_t));
+}
+
+// Function to read part of a file on the FAT filesystem without reading the rest
+// of the file. Only the blocks covering the requested range are read, and each 
+// run of contiguous blocks is read with a single read
+// Arguments: 
+//     fs: The filesystem
+//     handle: Handle on the file to read from
+//     offset: Offset in the file at which to start reading
+//     buf: The buffer to put the read bytes in
+//     n: The maximum number of bytes to read
+// Returns: 
+//     The number of bytes read (0 if offset is at or beyond the end of the file)
+int readFileAt(fileSystem *fs, fileHandle *handle, uint32_t offset, char *buf, uint32_t n) {
+    // Clamp the read to the end of the file
+    uint32_t size = getHandleSize(fs, handle);
+    if (offset >= size) return 0;
+    if (n > size - offset) n = size - offset;
+
+    // Copy the requested range, one run of contiguous blocks at a time
+    uint32_t numRead = 0;
+    while (numRead < n) {
+        off_t imageOffset;
+        uint32_t chunk = locateRange(fs, handle, offset + numRead, n - numRead, 0, &imageOffset);
+        if (chunk == 0) break; // Chain is shorter than the file size says
+        imageRead(fs, imageOffset, buf + numRead, chunk);
+        numRead += chunk;
+    }
+
+    return numRead;
+}
+
+// Function to overwrite a range of a file in place, adding blocks to the end of
+// the file as needed. Each run of contiguous blocks is written with a single 
+// write. Does not change the size of the file
+// Arguments: 
+//     fs: The filesystem
+//     handle: Handle on the file
+//     offset: Offset in the file at which to start writing
+//     buf: The bytes to write. If buf is NULL, zeros are written instead
+//     n: The number of bytes to write
+// Returns: 
+//     The number of bytes written, which is less than n only if the filesystem 
+//     ran out of free blocks
+static uint32_t writeRange(fileSystem *fs, fileHandle *handle, uint32_t offset, char *buf, uint32_t n) {
+    static const char zeros[MAX_BLOCK_SIZE]; // Source of the bytes when buf is NULL
+
+    uint32_t numWritten = 0;
+    while (numWritten < n) {
+        uint32_t length = n - numWritten;
+        // Zeros are written at most one block at a time
+        uint32_t blockLeft = fs -> blockSize - (offset + numWritten) % fs -> blockSize;
+        if (buf == NULL && length > blockLeft) 
+            length = blockLeft;
+        off_t imageOffset;
+        uint32_t chunk = locateRange(fs, handle, offset + numWritten, length, 1, &imageOffset);
+        if (chunk == 0) break; // There are no free blocks left
+        imageWrite(fs, imageOffset, (buf == NULL) ? zeros : buf + numWritten, chunk);
+        numWritten += chunk;
+    }
+
+    return numWritten;
+}
+
+// Function to write to part of a file on the FAT filesystem. Only the blocks 
+// covering the written range are written, and blocks are only added to the file
+// when the write goes past its last block. If offset is beyond the end of the 
+// file, the gap is filled with zeros. The size (if the file grew) and mtime of 
+// the file are updated in its directory entry
+// Arguments: 
+//     fs: The filesystem
+//     handle: Handle on the file to write to
+//     offset: Offset in the file at which to start writing
+//     buf: The bytes to write
+//     n: The number of bytes to write
+// Returns: 
+//     The number of bytes of buf written, which is less than n if the filesystem
+//     ran out of free blocks (the bytes that did fit are kept), or -1 if it ran 
+//     out before any byte of buf was written
+int writeFileAt(fileSystem *fs, fileHandle *handle, uint32_t offset, char *buf, uint32_t n) {
+    uint32_t size = getHandleSize(fs, handle);
+    uint32_t end = offset; // End of the range written so far
+    uint32_t numWritten = 0; // Number of bytes of buf written
+    int full = 0; // Set if the filesystem runs out of free blocks
+    // Fill any gap between the end of the file and offset with zeros
+    if (offset > size) {
+        uint32_t gap = offset - size;
+        uint32_t numZeroed = writeRange(fs, handle, size, NULL, gap);
+        if (numZeroed < gap) {
+            end = size + numZeroed;
+            full = 1;
+        }
+    }
+    if (!full) {
+        numWritten = writeRange(fs, handle, offset, buf, n);
+        end = offset + numWritten;
+    }
+
+    // Update the size (if the file grew) and mtime in the directory entry
+    updateWrittenEntry(fs, handle, end);
+
+    return (numWritten == 0 && n > 0) ? -1 : (int) numWritten;
+}
+
+// Function to truncate a file to size 0 in place. The file keeps its directory 
+// entry and first block, so handles on it stay valid, and the rest of its blocks 
+// are freed
+// Arguments: 
+//     fs: The filesystem
+//     fileName: Name of the file to truncate
+// Returns: 
+//     0 on success, -1 if fileName does not exist
+int truncateFile(fileSystem *fs, char *fileName) {
+    indexEntry *entry = lookupDirIndex(fs, fileName);
+    if (entry == NULL) return -1;
+
+    // Free every block after the first and make the first the last block
+    uint16_t firstBlock = entry -> handle.firstBlock;
+    uint16_t nextBlock = getFatEntry(fs, firstBlock);
+    if (nextBlock != 0xffff) {
+        setFatEntry(fs, firstBlock, 0xffff);
+        freeChain(fs, nextBlock);
+    }
+
+    // Set the size to 0 and update the mtime
+    uint32_t size = 0;
+    imageWrite(fs, entry -> handle.entryOffset + SIZE_OFFSET, &size, sizeof(uint32_t));
+    time_t newTime = time(NULL);
+    imageWrite(fs, entry -> handle.entryOffset + MTIME_OFFSET, &newTime, sizeof(time_t));
+
+    return 0;
+}
+
+// Function to free the blocks at the end of a file's chain that are past the end
+// of the file, which were reserved for it by addExtent. Called once the file is
+// no longer being written
+// Arguments: 
+//     fs: The filesystem
+//     handle: Handle on the file
+// Returns: 
+//     None
+void trimFile(fileSystem *fs, fileHandle *handle) {
+    // Number of blocks the file needs. Every file keeps at least its first block
+    uint32_t size = getHandleSize(fs, handle);
+    uint32_t numBlocks = (size + fs -> blockSize - 1) / fs -> blockSize;
+    if (numBlocks == 0) numBlocks = 1;
+
+    int lastBlock = findBlockAt(fs, handle, numBlocks - 1, 0);
+    if (lastBlock == -1) return;
+    uint16_t nextBlock = getFatEntry(fs, lastBlock);
+    if (nextBlock != 0xffff) {
+        setFatEntry(fs, lastBlock, 0xffff);
+        freeChain(fs, nextBlock);
+    }
+}
+
+// Function to read a file on the FAT filesystem. Each run of contiguous blocks 
+// of the file is read with a single read
+// Arguments: 
+//     fs: The filesystem
 //     fileName: The name of the file to read from
 //     retFileSize: A pointer to a uint32_t variable that the function will set to 
 //                  the size of the file, if it exists
 // Returns: 
 //     Null pointer if fileName does not exist, otherwise a string that is the 
 //     contents of the file 
-char *readFile(char *fileName, uint32_t *retFileSize) {
-    off_t offset = findFile(fileName);
-    if (offset == -1) return NULL; // If file does not exist return null pointer
-
-    int fd = open(fsName, O_RDWR);
+char *readFile(fileSystem *fs, char *fileName, uint32_t *retFileSize) {
+    indexEntry *entry = lookupDirIndex(fs, fileName);
+    if (entry == NULL) return NULL; // If file does not exist return null pointer
 
     // If file exists, find its size 
-    uint32_t fileSize;
-    lseek(fd, offset + SIZE_OFFSET, SEEK_SET);
-    read(fd, &fileSize, sizeof(uint32_t));
+    uint32_t fileSize = getHandleSize(fs, &(entry -> handle));
     // Allocate char array to store contents of the file
     char *buffer = malloc(fileSize * sizeof(char));
     // Set retFileSize
     *retFileSize = fileSize;
-    // Find first block of file
-    uint16_t currBlock;
-    lseek(fd, offset + FIRST_BLOCK_OFFSET, SEEK_SET);
-    read(fd, &currBlock, sizeof(uint16_t));
 
     // Read the contents of the file into buffer
-    uint32_t ind = 0; // Variable to keep track of where in the buffer we are 
-                      // currently writing to
-    while (currBlock != 0xffff) {
-        // Seek to the beginning of the current block
-        lseek(fd, fatSize + (currBlock - 1) * blockSize, SEEK_SET);
-        if (fileSize >= blockSize) { // If we have a block or more to write to the
-                                     // buffer, write the entire block at once 
-            // Read the current block into the buffer at the appropriate location
-            read(fd, buffer + ind, blockSize);
-            ind += blockSize;
-            fileSize -= blockSize; // fileSize keeps track of the number of bytes 
-                                   // left to read
-        } else {
-            read(fd, buffer + ind, fileSize);
-            break;
-        }
-        uint16_t nextBlock;
-        lseek(fd, currBlock * 2, SEEK_SET);
-        read(fd, &nextBlock, sizeof(uint16_t));
-        currBlock = nextBlock;
-    }
-
-    close(fd);
+    readFileAt(fs, &(entry -> handle), 0, buffer, fileSize);
 
     return buffer;
 }
@@ -347,20 +758,15 @@ char *readFile(char *fileName, uint32_t *retFileSize) {
 // entry in the FAT filesystem
 // TODO: ADD ERROR CHECKING IF GIVEN FILE IS INVALID
 // Arguments: 
+//     fs: The filesystem
 //     fileName: The name of the file to get the size of 
 // Returns: 
 //     The size of the file 
-uint32_t getFileSize(char *fileName) {
-    off_t offset = findFile(fileName);
-
-    int fd = open(fsName, O_RDWR);
+uint32_t getFileSize(fileSystem *fs, char *fileName) {
+    indexEntry *entry = lookupDirIndex(fs, fileName);
 
     // If file exists, find its size 
-    uint32_t fileSize;
-    lseek(fd, offset + SIZE_OFFSET, SEEK_SET);
-    read(fd, &fileSize, sizeof(uint32_t));
-
-    return fileSize;
+    return getHandleSize(fs, &(entry -> handle));
 }
 
 
@@ -369,186 +775,224 @@ uint32_t getFileSize(char *fileName) {
 //  In mode 0, the target file is overwritten. In mode 1, the target file is 
 // appended to. If the target file does not exist, it is created
 // Arguments: 
+//     fs: The filesystem
 //     fileName: Name of the file to write to
 //     buffer: The string to write to the file
 //     size: Size of buffer (in bytes)
 //     mode: The mode in which to write to the file
 // Returns: 
 //     0 if successful, -1 otherwise
-int writeFile(char *fileName, char *buffer, uint32_t size, int mode) {
-
-    off_t offset = findFile(fileName);
-    if (offset == -1) { // If fileName does not exist, we can treat it the same 
-                        // way we treat any mode 0 query to writeFile
-        mode = 0; 
-    }
+int writeFile(fileSystem *fs, char *fileName, char *buffer, uint32_t size, int mode) {
 
-    int fd = open(fsName, O_RDWR);
-    uint16_t firstBlock;
-    int currBlock; // Variable to keep track of the current block we are in
-    int currLoc; // Variable to keep track of our location within the current block
-
-    // If mode is 0, just delete the file and create a new file and then write 
-    // to the new file
-    if (mode == 0) {
-        deleteFile(fileName);
-        if (createNewFile(fileName, REG_FILE, YYN) == -1) {
-            close(fd);
+    indexEntry *entry = lookupDirIndex(fs, fileName);
+    if (entry == NULL) { // If fileName does not exist, create it. Since it is
+                         // empty, appending to it is the same as overwriting it
+        if (createNewFile(fs, fileName, REG_FILE, YYN) == -1) 
             return -1;
-        }
-        // Set the size of the newly created file
-        offset = findFile(fileName);
-        lseek(fd, offset + SIZE_OFFSET, SEEK_SET);
-        write(fd, &size, sizeof(uint32_t));
-        // Get the first block of the file and seek to it to begin writing
-        lseek(fd, offset + FIRST_BLOCK_OFFSET, SEEK_SET);
-        read(fd, &firstBlock, sizeof(uint16_t));
-        currBlock = firstBlock;
-        lseek(fd, fatSize + (currBlock - 1) * blockSize, SEEK_SET);
-        currLoc = 0;
-    } else { // This is the case in which we append to an existing file
-        // Find the current size of the file and set the new size of the file
-        uint32_t currSize; // Variable to get current size of fileName
-        lseek(fd, offset + SIZE_OFFSET, SEEK_SET);
-        read(fd, &currSize, sizeof(uint32_t));
-        uint32_t newSize = size + currSize; // CHECK TO SEE SIZE+CURRSIZE DOESN'T 
-                                            // EXCEED MAX FILE SIZE
-        lseek(fd, offset + SIZE_OFFSET, SEEK_SET);
-        write(fd, &newSize, sizeof(uint32_t));
-        // Get the first block in the file
-        lseek(fd, offset + FIRST_BLOCK_OFFSET, SEEK_SET);
-        read(fd, &firstBlock, sizeof(uint16_t));
-        currBlock = firstBlock;
-
-        // Update file mtime
-        lseek(fd, offset + MTIME_OFFSET, SEEK_SET);
-        time_t newTime = time(NULL);
-        write(fd, &newTime, sizeof(time_t));
-
-        // Seek to the end of fileName to begin writing 
-        while (currSize > 0) {
-            if (currSize == blockSize) {
-                currSize -= blockSize;
-                // The file ends right at the end of its last block, so we need
-                // to add a new block to the file to start writing the contents 
-                // of buffer to fileName 
-                currBlock = addBlock(currBlock);
-                if (currBlock == -1) {
-                    close(fd);
-                    return -1;
-                }
-                currLoc = 0;
-            } else if (currSize > blockSize) {
-                currSize -= blockSize;
-                uint16_t nextBlock;
-                lseek(fd, currBlock * 2, SEEK_SET);
-                read(fd, &nextBlock, sizeof(uint16_t));
-                currBlock = nextBlock;
-            } else {
-                currLoc = currSize;
-                currSize = 0;
-            }
-        }
-        lseek(fd, fatSize + (currBlock - 1) * blockSize + currLoc, SEEK_SET);
+        entry = lookupDirIndex(fs, fileName);
+    } else if (mode == 0) { // If mode is 0, truncate the file first
+        truncateFile(fs, fileName);
     }
 
-    // Write the contents of buffer to fileName. size keeps track of the amount
-    // left to write
-    int ind = 0; // Variable to keep track of where in buffer we are currently
-                 // writing from
-    // If we are currently in the middle of a block, write to the end of the block
-    // before starting the while loop
-    if (currLoc > 0) {
-        if (size >= blockSize - currLoc) {
-            write(fd, buffer + ind, blockSize - currLoc);
-            ind += blockSize - currLoc;
-            size -= (blockSize - currLoc);
-            // Don't add a new block if size is now 0
-            if (size != 0) {
-                currBlock = addBlock(currBlock);
-                if (currBlock == -1) {
-                    close(fd);
-                    return -1;
-                }
-                // Seek to the beginning of the new block 
-                lseek(fd, fatSize + (currBlock - 1) * blockSize, SEEK_SET);
-            }
+    // Write buffer at the end of the file. CHECK TO SEE SIZE+CURRSIZE DOESN'T 
+    // EXCEED MAX FILE SIZE
+    fileHandle *handle = &(entry -> handle);
+    int ret = writeFileAt(fs, handle, getHandleSize(fs, handle), buffer, size);
+    // Release the blocks reserved past the end of the file
+    trimFile(fs, handle);
+
+    return (ret == (int) size) ? 0 : -1;
+}
+
+// Function to write the contents of a file in the FAT filesystem directly from 
+// the mapped filesystem image, one run of contiguous blocks at a time, without 
+// copying the file into a buffer first. Only valid if the image is mounted with 
+// IMAGE_MMAP
+// Arguments: 
+//     fs: The filesystem
+//     fileName: Name of the file in the FAT filesystem to write out
+//     target: What to write to (TO_FAT_FILE, TO_HOST_FILE or TO_FD)
+//     fd: The file descriptor to write to (unused if target is TO_FAT_FILE)
+//     destName: The FAT file to overwrite (unused unless target is TO_FAT_FILE). 
+//     Must not be fileName
+// Returns: 
+//     0 on success, -1 on failure (eg: fileName does not exist)
+static int writeMappedFile(fileSystem *fs, char *fileName, int target, int fd, char *destName) {
+    indexEntry *entry = lookupDirIndex(fs, fileName);
+    if (entry == NULL) return -1;
+
+    uint32_t remaining = getHandleSize(fs, &(entry -> handle)); // Number of bytes 
+                                                               // of the file left to write
+    uint16_t currBlock = entry -> handle.firstBlock;
+
+    int first = 1; // Whether we are writing the first run of the file
+    do {
+        // Write out the run of contiguous blocks starting at currBlock at once
+        uint32_t numBlocks = (remaining + fs -> blockSize - 1) / fs -> blockSize;
+        uint32_t run = contiguousBlocks(fs, currBlock, (numBlocks == 0) ? 1 : numBlocks);
+        uint32_t len = (remaining < run * fs -> blockSize) ? remaining : run * fs -> blockSize;
+        char *data = imageAddress(fs, fs -> fatSize + (currBlock - 1) * fs -> blockSize);
+        if (target == TO_FAT_FILE) {
+            // The first run overwrites destName, the rest are appended
+            if (writeFile(fs, destName, data, len, first ? 0 : 1) == -1) 
+                return -1;
+        } else if (target == TO_HOST_FILE) {
+            if (write(fd, data, len) != len) 
+                return -1;
         } else {
-            write(fd, buffer + ind, size);
-            size = 0;
+            f_write(fd, data, len);
         }
+        remaining -= len;
+        first = 0;
+        currBlock += run - 1;
+        currBlock = getFatEntry(fs, currBlock);
+    } while (remaining > 0);
+
+    return 0;
+}
+
+
+// Function to copy a host file into a FAT file, or a FAT file out to a host file,
+// directly between the host file and the image, one run of contiguous blocks of
+// the FAT file at a time. Stops early if the host OS cannot copy between the 
+// files (eg: they are on different filesystems), so the caller can copy the rest
+// through a buffer
+// Arguments: 
+//     fs: The filesystem
+//     fd: File descriptor of the host file, at offset 0
+//     handle: Handle on the FAT file. If it is the destination, it must be empty
+//     toImage: Whether to copy from the host file into the FAT file (nonzero), or
+//              from the FAT file out to the host file (0)
+// Returns: 
+//     The number of bytes copied. The offset of the host file is left just past 
+//     them
+static uint32_t copyRuns(fileSystem *fs, int fd, fileHandle *handle, int toImage) {
+    uint32_t size; // Size of the source file
+    if (toImage) {
+        off_t hostSize = lseek(fd, 0, SEEK_END);
+        if (hostSize == -1 || hostSize > UINT32_MAX || lseek(fd, 0, SEEK_SET) == -1) 
+            return 0;
+        size = hostSize;
+    } else {
+        size = getHandleSize(fs, handle);
     }
-    while (size > 0) {
-        if (size >= blockSize) {
-            write(fd, buffer + ind, blockSize);
-            ind += blockSize;
-            size -= blockSize;
-            // Don't add a new block if size is now 0
-            if (size != 0) {
-                currBlock = addBlock(currBlock);
-                if (currBlock == -1) {
-                    close(fd);
-                    return -1;
-                }
-                // Seek to the beginning of the new block 
-                lseek(fd, fatSize + (currBlock - 1) * blockSize, SEEK_SET);
-            }
-        } else {
-            write(fd, buffer + ind, size);
-            size = 0;
-        }
+
+    uint32_t copied = 0;
+    while (copied < size) {
+        off_t imageOffset;
+        uint32_t length = locateRange(fs, handle, copied, size - copied, toImage, &imageOffset);
+        if (length == 0) break; // There are no free blocks left
+        ssize_t n = toImage ? imageCopyFrom(fs, fd, imageOffset, length) 
+                            : imageCopyTo(fs, fd, imageOffset, length);
+        copied += n;
+        if (toImage && n > 0) 
+            updateWrittenEntry(fs, handle, copied);
+        if (n < length) break;
     }
 
-    close(fd);
-    return 0;
+    return copied;
 }
 
 
 // Function to implement cp. Copies src to dest. There are three modes. If mode is 
 // 0, both src and dest are in the FAT filesystem. If mode is 1, src is from the 
 // host OS. If mode is 2, dest is from the host OS. dest gets created if it does
-// not exist. If dest exists, it gets overwritten
+// not exist. If dest exists, it gets overwritten. The file is copied in chunks of
+// CP_CHUNK_SIZE bytes, so it is never held in memory in its entirety
 // Arguments: 
+//     fs: The filesystem
 //     src: Source filename
 //     dest: Destination filename
 //     mode: The mode in which to carry out the function
 // Returns: 
 //     0 on success, -1 on failure (eg: src does not exist)
-int cp(char *src, char *dest, int mode) {
-    // Variable for the string that will hold the contents from src that we will 
-    // write to dest
-    char *buffer;
-    uint32_t fileSize;
-    if (mode == 0 || mode == 2) { // src is in the FAT filesystem
-        buffer = readFile(src, &fileSize);
-        // If file does not exist, return -1
-        if (buffer == NULL) return -1;
-    } else { // src is from host OS
-        int fd = open(src, O_RDWR);
-        // If file does not exist, return -1
+int cp(fileSystem *fs, char *src, char *dest, int mode) {
+    // If the image is mapped, a FAT src can be written out directly from the 
+    // mapping (unless it is also the destination)
+    if (imageAddress(fs, 0) != NULL && (mode == 2 || (mode == 0 && strcmp(src, dest) != 0))) {
+        if (mode == 0) 
+            return writeMappedFile(fs, src, TO_FAT_FILE, -1, dest);
+        if (findFile(fs, src) == -1) 
+            return -1;
+        int fd = open(dest, O_WRONLY | O_CREAT | O_TRUNC, 0644);
         if (fd == -1) return -1;
-        // Get the size of src
-        fileSize = lseek(fd, 0, SEEK_END);
-        buffer = malloc(fileSize * sizeof(char));
-        lseek(fd, 0, SEEK_SET); // Seek back to beginning of src
-        read(fd, buffer, fileSize);
-
+        int ret = writeMappedFile(fs, src, TO_HOST_FILE, fd, NULL);
         close(fd);
+        return ret;
     }
 
-    if (mode == 0 || mode == 1) { // dest is in FAT filesystem
-        writeFile(dest, buffer, fileSize, 0);
-    } else { // dest is in host OS
-        int fd = open(dest, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-        write(fd, buffer, fileSize);
+    // Copying a FAT file onto itself leaves it unchanged
+    if (mode == 0 && strcmp(src, dest) == 0) 
+        return (findFile(fs, src) == -1) ? -1 : 0;
+
+    // Open src
+    int srcFd = -1; // File descriptor of src if it is from the host OS
+    fileHandle srcHandle; // Handle on src if it is in the FAT filesystem
+    if (mode == 1) {
+        srcFd = open(src, O_RDONLY);
+        if (srcFd == -1) return -1;
+    } else if (openFileHandle(fs, src, &srcHandle) == -1) {
+        return -1;
+    }
 
-        close(fd);
+    // Open dest, creating it if it does not exist and truncating it otherwise
+    int destFd = -1; // File descriptor of dest if it is from the host OS
+    fileHandle destHandle; // Handle on dest if it is in the FAT filesystem
+    int opened; // Whether dest was opened
+    if (mode == 2) {
+        destFd = open(dest, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        opened = (destFd != -1);
+    } else {
+        if (findFile(fs, dest) == -1) 
+            opened = (createNewFile(fs, dest, REG_FILE, YYN) == 0);
+        else 
+            opened = (truncateFile(fs, dest) == 0);
+        if (opened) 
+            openFileHandle(fs, dest, &destHandle);
+    }
+    if (!opened) {
+        if (srcFd != -1) close(srcFd);
+        return -1;
     }
 
-    // If buffer was malloc'd, free buffer.
-    if (mode == 1) free(buffer);
+    // Copy between the host file and the image directly if the host OS can. 
+    // Whatever is left is copied through a buffer one chunk at a time, so that 
+    // memory use does not depend on the size of src
+    uint32_t copied = 0; // Number of bytes copied so far
+    if (mode == 1) 
+        copied = copyRuns(fs, srcFd, &destHandle, 1);
+    else if (mode == 2) 
+        copied = copyRuns(fs, destFd, &srcHandle, 0);
+    char *chunk = malloc(CP_CHUNK_SIZE);
+    int ret = 0;
+    while (1) {
+        ssize_t n;
+        if (mode == 1) 
+            n = read(srcFd, chunk, CP_CHUNK_SIZE);
+        else 
+            n = readFileAt(fs, &srcHandle, copied, chunk, CP_CHUNK_SIZE);
+        if (n <= 0) { // We have reached the end of src, or the read failed
+            if (n == -1) ret = -1;
+            break;
+        }
 
-    return 0;
+        if (mode == 2) {
+            if (write(destFd, chunk, n) != n) ret = -1;
+        } else if (writeFileAt(fs, &destHandle, copied, chunk, n) != n) {
+            ret = -1;
+        }
+        if (ret == -1) break;
+        copied += n;
+    }
+    free(chunk);
+
+    if (srcFd != -1) close(srcFd);
+    if (mode == 2) 
+        close(destFd);
+    else 
+        trimFile(fs, &destHandle); // Release the blocks reserved past the end of dest
+
+    return ret;
 }
 
 // Function to implement cat. There are three modes. If mode is 0, the specified 
@@ -557,18 +1001,26 @@ int cp(char *src, char *dest, int mode) {
 // overwritten. If mode is 2, it is the same as mode 1, but the specified file is 
 // appended to. If outFile does not exist, it is created
 // Arguments: 
+//     fs: The filesystem
 //     fileNames: Array of the names of the files to be concatenated
 //     numFiles: Length of fileNames
 //     mode: The mode in which to carry out the function
 //     outFile: The file to write the output of the function to (unused if mode is 0)
 // Returns: 
 //     0 on success, -1 on failure
-int cat(char **fileNames, int numFiles, int mode, char *outFile) {
+int cat(fileSystem *fs, char **fileNames, int numFiles, int mode, char *outFile) {
     // Variable to keep track of whether outFile has been written to yet
     int firstWriteDone = 0;
     for (int i = 0; i < numFiles; i++) {
+        // If the image is mapped, write the file to stdout directly from the 
+        // mapping
+        if (mode == 0 && imageAddress(fs, 0) != NULL && 
+            writeMappedFile(fs, fileNames[i], TO_FD, STDOUT_FILENO, NULL) == 0) {
+            f_write(STDOUT_FILENO, "\n", 1);
+            continue;
+        }
         uint32_t fileSize;
-        char *buffer = readFile(fileNames[i], &fileSize);
+        char *buffer = readFile(fs, fileNames[i], &fileSize);
         if (buffer == NULL) { // The file fileNames[i] does not exist
             char *str = ": No such file or directory\n";
             if (mode == 0) {
@@ -578,15 +1030,15 @@ int cat(char **fileNames, int numFiles, int mode, char *outFile) {
                                     // to outFile, we need to overwrite it. Otherwise,
                                     // we need to append to it
                 if (firstWriteDone) 
-                    writeFile(outFile, fileNames[i], strlen(fileNames[i]), 1);
+                    writeFile(fs, outFile, fileNames[i], strlen(fileNames[i]), 1);
                 else
-                    writeFile(outFile, fileNames[i], strlen(fileNames[i]), 0);
+                    writeFile(fs, outFile, fileNames[i], strlen(fileNames[i]), 0);
                 
                 firstWriteDone = 1;
-                writeFile(outFile, str, strlen(str), 1);
+                writeFile(fs, outFile, str, strlen(str), 1);
             } else { // If mode is 2 we simply need to append to the file
-                writeFile(outFile, fileNames[i], strlen(fileNames[i]), 1);
-                writeFile(outFile, str, strlen(str), 1);
+                writeFile(fs, outFile, fileNames[i], strlen(fileNames[i]), 1);
+                writeFile(fs, outFile, str, strlen(str), 1);
             }
             continue;
         }
@@ -599,15 +1051,15 @@ int cat(char **fileNames, int numFiles, int mode, char *outFile) {
                                 // to outFile, we need to overwrite it. Otherwise,
                                 // we need to append to it
             if (firstWriteDone) 
-                writeFile(outFile, buffer, fileSize, 1);
+                writeFile(fs, outFile, buffer, fileSize, 1);
             else
-                writeFile(outFile, buffer, fileSize, 0);
+                writeFile(fs, outFile, buffer, fileSize, 0);
             
             firstWriteDone = 1;
-            writeFile(outFile, "\n", 1, 1);
+            writeFile(fs, outFile, "\n", 1, 1);
         } else { // If mode is 2 we simply need to append to the file
-            writeFile(outFile, buffer, fileSize, 1);
-            writeFile(outFile, "\n", 1, 1);
+            writeFile(fs, outFile, buffer, fileSize, 1);
+            writeFile(fs, outFile, "\n", 1, 1);
         }
     }
 
@@ -615,125 +1067,107 @@ int cat(char **fileNames, int numFiles, int mode, char *outFile) {
 }
 
 
-// Function to implement mv. Renames src to dest and deletes src. If dest does
-// not exist, it is created. If it does exists, its contents are overwritten with
-// those of src
+// Function to implement mv. Renames src to dest by rewriting the name in src's 
+// directory entry, so that none of its data is copied. src stays open for any 
+// process that has it open, since it keeps its directory entry. dest must not 
+// exist: a caller replacing dest has to unlink it first, the same way rm does,
+// so that its blocks are only freed once it is no longer open
 // Arguments: 
+//     fs: The filesystem
 //     src: Source file filename
 //     dest: Destination file filename
 // Returns: 
-//     0 on success, -1 otherwise (eg: src does not exist) 
-int mv(char *src, char *dest) {
-    off_t offset = findFile(src);
+//     0 on success, -1 otherwise (eg: src does not exist, dest exists) 
+int mv(fileSystem *fs, char *src, char *dest) {
+    indexEntry *entry = lookupDirIndex(fs, src);
     // If file does not exist, return -1
-    if (offset == -1) return -1;
+    if (entry == NULL) return -1;
     // If src and dest are the same, do nothing
     if (strcmp(src, dest) == 0) return 0;
+    if (strlen(dest) > NAME_SIZE) return -1;
+    // If dest has not been unlinked, return -1
+    if (lookupDirIndex(fs, dest) != NULL) return -1;
 
-    // Copy the contents of src to dest
-    cp(src, dest, 0);
-    // Delete src
-    deleteFile(src);
+    fileHandle handle = entry -> handle;
+
+    // Write the new name (padded with 0's) to src's directory entry
+    char name[NAME_SIZE];
+    strncpy(name, dest, NAME_SIZE);
+    imageWrite(fs, handle.entryOffset, name, NAME_SIZE);
+    removeFromDirIndex(fs, src);
+    addToDirIndex(fs, dest, handle.entryOffset, handle.firstBlock);
 
     return 0;
 }
 
 // Function to implement ls. Prints the information for each file in the filesystem
 // on a new line. The columns printed for each file are first block number, 
-// permissions, size, month, day, time, name.  
+// permissions, size, month, day, time, name. Each block of the directory is read
+// with a single read, and the output is formatted into a buffer that is written 
+// to the calling process's fd 1 whenever it fills up
 // Arguments: 
-//     None
+//     fs: The filesystem
 // Returns: 
 //     None
-void ls(void) {
-    int fd = open(fsName, O_RDWR);
+void ls(fileSystem *fs) {
+    char block[MAX_BLOCK_SIZE]; // The current block of the root directory
+    char out[LS_BUFFER_SIZE]; // Output not yet written to fd 1
+    int outLen = 0; // Number of bytes in out
+
+    // Iterate through all root directory entries to print them
     int currBlock = 1; // The current block in the root directory that we are in
-    int currLoc = 0; // The current location we are at in the current block
     int endReached = 0; // Variable to track whether we have reached the end of 
                         // the directory
+    while (currBlock != 0xffff && !endReached) {
+        imageRead(fs, fs -> fatSize + (off_t) (currBlock - 1) * fs -> blockSize, block, fs -> blockSize);
 
-    // Iterate through all root directory entries to print them
-    while (currBlock != 0xffff) {
-        while (currLoc < blockSize) {
-            // Offset to beginning of current directory entry
-            off_t offset = fatSize + (currBlock - 1) * blockSize + currLoc;
-
+        for (int currLoc = 0; currLoc < fs -> blockSize; currLoc += DIR_ENTRY_SIZE) {
+            dirEntry entry;
+            memcpy(&entry, block + currLoc, DIR_ENTRY_SIZE);
             // Check whether we have reached the end of the directory or if we are 
             // at a deleted entry
-            lseek(fd, offset, SEEK_SET);
-            char c;
-            read(fd, &c, 1);
-            if (c == 0) { // We have reached the end of the directory 
+            if (entry.name[0] == DIR_END) { 
                 endReached = 1;
                 break;
-            } else if (c == 1 || c == 2) { // We are at a deleted entry
-                currLoc += DIR_ENTRY_SIZE;
+            } else if (entry.name[0] == DEL_FILE_1 || entry.name[0] == DEL_FILE_2) {
                 continue;
             }
 
-            // Print first block number
-            lseek(fd, offset + FIRST_BLOCK_OFFSET, SEEK_SET);
-            uint16_t firstBlock;
-            read(fd, &firstBlock, sizeof(uint16_t));
-            printf("%d ", firstBlock);
-            // Print the permissions
-            lseek(fd, offset + PERMS_OFFSET, SEEK_SET);
-            uint8_t perms;
-            read(fd, &perms, sizeof(uint8_t));
-            ((perms & 4) == 0) ? printf("-") : printf("r");
-            ((perms & 2) == 0) ? printf("-") : printf("w");
-            ((perms & 1) == 0) ? printf("-") : printf("x");
-            printf(" ");
-            // Print size
-            lseek(fd, offset + SIZE_OFFSET, SEEK_SET);
-            uint32_t size;
-            read(fd, &size, sizeof(uint32_t));
-            printf("%u ", size);
-            // Print the date and time
-            lseek(fd, offset + MTIME_OFFSET, SEEK_SET);
-            time_t mtime;
-            read(fd, &mtime, sizeof(time_t));
-            struct tm tm = *localtime(&mtime);
-            printf("%s %02d %02d:%02d:%02d ", months[tm.tm_mon], tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
-            // Print file name
-            lseek(fd, offset, SEEK_SET);
-            char name[NAME_SIZE];
-            read(fd, name, NAME_SIZE);
-            printf("%s\n", name);
-
-            currLoc += DIR_ENTRY_SIZE;
+            // Write out the buffer if the line might not fit
+            if (outLen + LS_MAX_LINE > LS_BUFFER_SIZE) {
+                f_write(STDOUT_FILENO, out, outLen);
+                outLen = 0;
+            }
+            struct tm tm = *localtime(&(entry.mtime));
+            outLen += snprintf(out + outLen, LS_BUFFER_SIZE - outLen, 
+                "%d %c%c%c %u %s %02d %02d:%02d:%02d %.*s\n", entry.firstBlock, 
+                (entry.perm & 4) ? 'r' : '-', (entry.perm & 2) ? 'w' : '-', 
+                (entry.perm & 1) ? 'x' : '-', entry.size, months[tm.tm_mon], 
+                tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, NAME_SIZE, entry.name);
         }
-        if (endReached) break;
         // Get the next block in the root directory from the FAT
-        lseek(fd, currBlock * 2, SEEK_SET);
-        uint16_t nextBlock;
-        read(fd, &nextBlock, sizeof(uint16_t));
-        currBlock = nextBlock;
-        currLoc = 0;
+        currBlock = getFatEntry(fs, currBlock);
     }
 
-    close(fd);
+    if (outLen > 0) 
+        f_write(STDOUT_FILENO, out, outLen);
 }
 
 
 // Function to implement chmod. Changes permissions of the specified file.
 // Arguments: 
+//     fs: The filesystem
 //     fileName: The name of the file whose permissions to change
 //     perms: The new permissions 
 // Returns:
 //     0 on success, -1 otherwise (eg: fileName does not exist)
-int chmod(char *fileName, uint8_t perms) {
-    off_t offset = findFile(fileName);
+int chmod(fileSystem *fs, char *fileName, uint8_t perms) {
+    off_t offset = findFile(fs, fileName);
     // If fileName does not exist, return -1
     if (offset == -1) return -1;
 
-    int fd = open(fsName, O_RDWR);
-
-    // Seek to the appropriate location in the directory entry to rewrite 
-    // permissions
-    lseek(fd, offset + PERMS_OFFSET, SEEK_SET);
-    write(fd, &perms, sizeof(uint8_t));
-    close(fd);
+    // Rewrite the permissions in the appropriate location in the directory entry
+    imageWrite(fs, offset + PERMS_OFFSET, &perms, sizeof(uint8_t));
 
     return 0;
 }
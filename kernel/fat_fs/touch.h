@@ -2,20 +2,29 @@
 #define TOUCH_H
 
 #include <stdint.h>
+#include "headers.h"
 
-int findFreeBlock(void);
-int addBlock(int lastBlock);
-int createNewFile(char *fileName, uint8_t type, uint8_t perm);
-off_t findFile(char *fileName);
-int touch(char **fileNames, int numFiles);
-int deleteFile(char *fileName);
-char *readFile(char *fileName, uint32_t *retFileSize);
-uint32_t getFileSize(char *fileName);
-int writeFile(char *fileName, char *buffer, uint32_t size, int mode);
-int cp(char *src, char *dest, int mode);
-int cat(char **fileNames, int numFiles, int mode, char *outFile);
-int mv(char *src, char *dest);
-void ls(void);
-int chmod(char *fileName, uint8_t perms);
+int addBlock(fileSystem *fs, int lastBlock);
+int createNewFile(fileSystem *fs, char *fileName, uint8_t type, uint8_t perm);
+off_t findFile(fileSystem *fs, char *fileName);
+int touch(fileSystem *fs, char **fileNames, int numFiles);
+int openFileHandle(fileSystem *fs, char *fileName, fileHandle *handle);
+int unlinkFile(fileSystem *fs, char *fileName);
+void releaseFile(fileSystem *fs, fileHandle *handle);
+int deleteFile(fileSystem *fs, char *fileName);
+int compactDirectory(fileSystem *fs, void (*entryMoved)(off_t oldOffset, off_t newOffset));
+char *readFile(fileSystem *fs, char *fileName, uint32_t *retFileSize);
+uint32_t getHandleSize(fileSystem *fs, fileHandle *handle);
+int readFileAt(fileSystem *fs, fileHandle *handle, uint32_t offset, char *buf, uint32_t n);
+int writeFileAt(fileSystem *fs, fileHandle *handle, uint32_t offset, char *buf, uint32_t n);
+int truncateFile(fileSystem *fs, char *fileName);
+void trimFile(fileSystem *fs, fileHandle *handle);
+uint32_t getFileSize(fileSystem *fs, char *fileName);
+int writeFile(fileSystem *fs, char *fileName, char *buffer, uint32_t size, int mode);
+int cp(fileSystem *fs, char *src, char *dest, int mode);
+int cat(fileSystem *fs, char **fileNames, int numFiles, int mode, char *outFile);
+int mv(fileSystem *fs, char *src, char *dest);
+void ls(fileSystem *fs);
+int chmod(fileSystem *fs, char *fileName, uint8_t perms);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,249 @@
+// System-wide tables of open files and open file descriptions. File descriptor
+// tables hold indices into the open file description table, and each open file
+// description of a file in the FAT filesystem refers to the file's entry in the
+// open file table. Both tables are arrays that grow when they are full, and
+// unused entries (refCount of 0) are reused
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "kernel.h"
+#include "fileTable.h"
+#include "fat_fs/headers.h"
+#include "fat_fs/touch.h"
+
+// Number of entries each table starts with
+#define INITIAL_TABLE_SIZE 16
+
+extern fileSystem *mountedFs;
+
+// Variables for the open file table
+openFile *fileTable = NULL;
+int fileTableSize = 0;
+// Variables for the open file description table
+openFileDesc *descTable = NULL;
+int descTableSize = 0;
+
+
+// Function to get an unused entry of the open file table, doubling the size of 
+// the table if it is full
+// Arguments: 
+//     None
+// Returns: 
+//     Index of the unused entry
+static int newOpenFile(void) {
+    for (int i = 0; i < fileTableSize; i++) {
+        if (fileTable[i].refCount == 0)
+            return i;
+    }
+
+    int oldSize = fileTableSize;
+    fileTableSize = (oldSize == 0) ? INITIAL_TABLE_SIZE : oldSize * 2;
+    fileTable = realloc(fileTable, fileTableSize * sizeof(openFile));
+    memset(fileTable + oldSize, 0, (fileTableSize - oldSize) * sizeof(openFile));
+
+    return oldSize;
+}
+
+
+// Function to get an unused entry of the open file description table, doubling
+// the size of the table if it is full
+// Arguments: 
+//     None
+// Returns: 
+//     Index of the unused entry
+static int newDesc(void) {
+    for (int i = 0; i < descTableSize; i++) {
+        if (descTable[i].refCount == 0)
+            return i;
+    }
+
+    int oldSize = descTableSize;
+    descTableSize = (oldSize == 0) ? INITIAL_TABLE_SIZE : oldSize * 2;
+    descTable = realloc(descTable, descTableSize * sizeof(openFileDesc));
+    memset(descTable + oldSize, 0, (descTableSize - oldSize) * sizeof(openFileDesc));
+
+    return oldSize;
+}
+
+
+// Function to find the entry of a file in the open file table
+// Arguments: 
+//     entryOffset: Offset of the file's directory entry in the filesystem image
+// Returns: 
+//     Index of the file's entry, or -1 if the file is not open
+static int findOpenFile(off_t entryOffset) {
+    for (int i = 0; i < fileTableSize; i++) {
+        // Unlinked files are skipped, since their directory entries are no longer
+        // reachable by name
+        if (fileTable[i].refCount > 0 && !fileTable[i].unlinked &&
+                fileTable[i].handle.entryOffset == entryOffset)
+            return i;
+    }
+
+    return -1;
+}
+
+
+// Function to update the handles on a file whose directory entry was moved by 
+// compactDirectory
+// Arguments: 
+//     oldOffset: Offset the directory entry was moved from
+//     newOffset: Offset the directory entry was moved to
+// Returns: 
+//     None
+static void moveOpenFileEntry(off_t oldOffset, off_t newOffset) {
+    for (int i = 0; i < fileTableSize; i++) {
+        if (fileTable[i].refCount > 0 && fileTable[i].handle.entryOffset == oldOffset)
+            fileTable[i].handle.entryOffset = newOffset;
+    }
+    for (int i = 0; i < descTableSize; i++) {
+        if (descTable[i].refCount > 0 && descTable[i].type == FILE_DESC && 
+                descTable[i].handle.entryOffset == oldOffset)
+            descTable[i].handle.entryOffset = newOffset;
+    }
+}
+
+
+// Function to create an open file description for a file in the FAT filesystem.
+// Assumes the file exists and, if mode is F_WRITE, that it has already been
+// truncated. If mode is F_APPEND, the file offset starts at the end of the file
+// Arguments: 
+//     fileName: Name of the file
+//     mode: The mode in which to open the file (F_WRITE, F_READ, or F_APPEND)
+// Returns: 
+//     Index of the new open file description, or -1 if the file does not exist
+int openDesc(char *fileName, int mode) {
+    fileHandle handle;
+    if (openFileHandle(mountedFs, fileName, &handle) == -1) return -1;
+
+    // Find the file's entry in the open file table, creating it if the file is
+    // not open yet
+    int file = findOpenFile(handle.entryOffset);
+    if (file == -1) {
+        file = newOpenFile();
+        fileTable[file].handle = handle;
+        fileTable[file].numWriters = 0;
+        fileTable[file].unlinked = 0;
+    }
+    fileTable[file].refCount += 1;
+    if (mode == F_WRITE)
+        fileTable[file].numWriters += 1;
+
+    // Create the open file description
+    int desc = newDesc();
+    descTable[desc].refCount = 1;
+    descTable[desc].type = FILE_DESC;
+    descTable[desc].file = file;
+    descTable[desc].mode = mode;
+    descTable[desc].handle = handle;
+    descTable[desc].loc = (mode == F_APPEND) ? getHandleSize(mountedFs, &handle) : 0;
+
+    return desc;
+}
+
+
+// Function to create an open file description for the terminal
+// Arguments: 
+//     type: STDIN_DESC or STDOUT_DESC
+// Returns: 
+//     Index of the new open file description
+int openStdDesc(int type) {
+    int desc = newDesc();
+    descTable[desc].refCount = 1;
+    descTable[desc].type = type;
+    descTable[desc].file = -1;
+    descTable[desc].mode = (type == STDIN_DESC) ? F_READ : F_WRITE;
+    descTable[desc].loc = 0;
+
+    return desc;
+}
+
+
+// Function to get an open file description
+// Arguments: 
+//     desc: Index of the open file description
+// Returns: 
+//     A pointer to the open file description. The pointer is only valid until
+//     the next description is created
+openFileDesc *getDesc(int desc) {
+    return &(descTable[desc]);
+}
+
+
+// Function to add a reference to an open file description, for a file descriptor
+// duplicated from another
+// Arguments: 
+//     desc: Index of the open file description
+// Returns: 
+//     None
+void retainDesc(int desc) {
+    descTable[desc].refCount += 1;
+}
+
+
+// Function to remove a reference to an open file description. When its last
+// reference is removed, the description is freed. If it was the last open file
+// description of a file, the file is freed if it has been unlinked (and the 
+// directory compacted if needed), and the blocks reserved past its end are 
+// released otherwise
+// Arguments: 
+//     desc: Index of the open file description
+// Returns: 
+//     None
+void releaseDesc(int desc) {
+    openFileDesc *description = &(descTable[desc]);
+    description -> refCount -= 1;
+    if (description -> refCount > 0 || description -> type != FILE_DESC) return;
+
+    openFile *file = &(fileTable[description -> file]);
+    file -> refCount -= 1;
+    if (description -> mode == F_WRITE)
+        file -> numWriters -= 1;
+    if (file -> refCount == 0 && file -> unlinked) {
+        releaseFile(mountedFs, &(file -> handle));
+        compactDirectory(mountedFs, moveOpenFileEntry);
+    } else if (file -> refCount == 0)
+        trimFile(mountedFs, &(file -> handle)); // Release the blocks reserved past 
+                                                // the end of the file
+}
+
+
+// Function to check whether a file is open with mode F_WRITE by any process
+// Arguments: 
+//     fileName: Name of the file
+// Returns: 
+//     1 if the file is open with mode F_WRITE, 0 otherwise
+int isOpenForWriting(char *fileName) {
+    off_t entryOffset = findFile(mountedFs, fileName);
+    if (entryOffset == -1) return 0;
+    int file = findOpenFile(entryOffset);
+
+    return file != -1 && fileTable[file].numWriters > 0;
+}
+
+
+// Function to delete a file from the FAT filesystem. If the file is open, it is
+// only unlinked (its directory entry is marked DEL_FILE_2), and its directory
+// entry and blocks are freed when it is last closed. The directory is compacted 
+// if it has become mostly deleted entries
+// Arguments: 
+//     fileName: Name of the file to delete
+// Returns: 
+//     0 on success, -1 otherwise (eg: the file does not exist)
+int unlinkOpenFile(char *fileName) {
+    off_t entryOffset = findFile(mountedFs, fileName);
+    if (entryOffset == -1) return -1;
+
+    int file = findOpenFile(entryOffset);
+    if (file != -1) {
+        fileTable[file].unlinked = 1;
+        return unlinkFile(mountedFs, fileName);
+    }
+
+    deleteFile(mountedFs, fileName);
+    compactDirectory(mountedFs, moveOpenFileEntry);
+    return 0;
+}
@@ -0,0 +1,14 @@
+#ifndef FILE_TABLE_H
+#define FILE_TABLE_H
+
+#include "kernel.h"
+
+int openDesc(char *fileName, int mode);
+int openStdDesc(int type);
+openFileDesc *getDesc(int desc);
+void retainDesc(int desc);
+void releaseDesc(int desc);
+int isOpenForWriting(char *fileName);
+int unlinkOpenFile(char *fileName);
+
+#endif
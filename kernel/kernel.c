@@ -15,20 +15,22 @@
 #include "userFunctions.h"
 #include "fat_fs/touch.h"
 #include "fat_fs/mkfs.h"
+#include "fat_fs/image.h"
 #include "shell/shell.h"
 
-extern linkedList *lowPriorityQueue;
-extern linkedList *middlePriorityQueue;
-extern linkedList *highPriorityQueue;
+extern runQueue lowPriorityQueue;
+extern runQueue middlePriorityQueue;
+extern runQueue highPriorityQueue;
 extern linkedList *waitpidBlocked;
-extern linkedList *sleepBlocked;
-extern linkedList *processTable;
+extern pcb **processTable;
+extern int processTableSize;
+extern unsigned long clockTicks;
 extern ucontext_t *kernelContext;
 extern ucontext_t *newContext;
 extern ucontext_t *idleProcessContext;
 extern pcb *currentProcessPcb;
 extern int currentProcessPid;
-extern char *bitmap;
+extern fileSystem *mountedFs;
 extern int foregroundProcessPid;
 
 int wstatus;
@@ -46,20 +48,38 @@ int main(void) {
     signal(SIGTSTP, handler);
 
     // Initialize kernel lists
-    lowPriorityQueue = createList();
-    middlePriorityQueue = createList();
-    highPriorityQueue = createList();
-    processTable = createList();
     waitpidBlocked = createList();
-    sleepBlocked = createList();
     // Initialize kernelContext
     kernelContext = malloc(sizeof(ucontext_t));
 
-    // Set seed for rand
-    srand(time(NULL));
-
-    // Create the filesystem
-    mkfs("fs", 1, 0, bitmap);
+    // Mount the filesystem, keeping the files from previous runs. The image is 
+    // only formatted if it does not exist yet or its header shows it was not 
+    // created by mkfs. If it cannot be accessed for any other reason, the kernel
+    // exits rather than overwrite it. The image is mapped into memory, and 
+    // modified pages are scheduled for writeback whenever a file is closed
+    int imageStatus = checkImage("fs");
+    if (imageStatus == -1) {
+        perror("Cannot access fs");
+        exit(EXIT_FAILURE);
+    }
+    if (imageStatus == IMAGE_MISSING || imageStatus == IMAGE_INVALID) {
+        struct timespec formatStart, formatEnd;
+        clock_gettime(CLOCK_MONOTONIC, &formatStart);
+        if (mkfs("fs", 1, 0, MKFS_SPARSE) == -1) {
+            perror("Cannot format fs");
+            exit(EXIT_FAILURE);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &formatEnd);
+        printf("Formatted fs in %.3f ms\n", 
+            (formatEnd.tv_sec - formatStart.tv_sec) * 1e3 + (formatEnd.tv_nsec - formatStart.tv_nsec) / 1e6);
+        // Flush the line now, since the rest of the output bypasses stdio
+        fflush(stdout);
+    }
+    mountedFs = mountImage("fs", IMAGE_MMAP, SYNC_ASYNC);
+    if (mountedFs == NULL) {
+        fprintf(stderr, "Cannot mount fs\n");
+        exit(EXIT_FAILURE);
+    }
 
     // Create root process
     newContext = malloc(sizeof(ucontext_t));
@@ -92,24 +112,9 @@ int main(void) {
                                              // run the kernel thread afterwards
     makecontext(idleProcessContext, idleProcessFunc, 0);
 
-    // Create the timer for the system clock
-    struct itimerval timer;
-    struct timeval tval_interval;
-    struct timeval tval_value;
-
-    tval_interval.tv_sec = 0;
-    tval_interval.tv_usec = 100000;
-    tval_value.tv_sec = 0;
-    tval_value.tv_usec = 100000;
-    // tval_interval.tv_sec = 3;
-    // tval_interval.tv_usec = 0;
-    // tval_value.tv_sec = 3;
-    // tval_value.tv_usec = 0;
-
-    timer.it_interval = tval_interval;
-    timer.it_value = tval_value;
-
-    setitimer(ITIMER_REAL, &timer, NULL);
+    // Start the system clock. The timer for the clock is set by the kernel loop
+    // every time it chooses a process to run
+    startClock();
 
     // TODO: IN F_READ FUNCTION, IN THE READ FROM STDIN CASE, CHECK IF THE CURRENT
     // PROCESS IS THE FOREGROUND PROCESS AND IF IT IS NOT, SEND A SIGSTOP TO THE 
@@ -159,6 +164,15 @@ int main(void) {
 
     // int fd = open("log", O_RDWR | O_CREAT, 0644);
 
+    // Block SIGALRM while the kernel runs, so that a timer that expires before 
+    // the chosen process starts running does not interrupt the kernel. Processes 
+    // run with SIGALRM unblocked, so the signal is delivered once the kernel 
+    // swaps to one
+    sigset_t alarmMask;
+    sigemptyset(&alarmMask);
+    sigaddset(&alarmMask, SIGALRM);
+    sigprocmask(SIG_BLOCK, &alarmMask, NULL);
+
     while (1) {
         // If the process that was just running is not the idle process and is 
         // still runnable, put it back in the appropriate scheduler queue
@@ -169,24 +183,27 @@ int main(void) {
                 int state = currentProcessPcb -> state;
                 // Check if the process that was just running is still runnable
                 if (state == RUNNING_STATE || state == ORPHANED_STATE) 
-                    addToScheduler(currentProcessPid, currentProcessPcb -> priority);
+                    addToScheduler(currentProcessPcb);
             }
         }
             
-        // Examine the sleepBlocked queue
-        lNode *currNode = sleepBlocked -> head;
-        while (currNode != NULL) {
-            sleepBlockedEntry *entry = (sleepBlockedEntry*)(currNode -> payload);
-            entry -> ticks -= 1;
-            // If entry -> ticks is now 0, we need to unblock this entry's process
-            if ((entry -> ticks) == 0)
-                unblockProcess(entry -> pid);
-            
-            currNode = currNode -> next;
-        }
+        // Advance the clock, which unblocks the sleeping processes that are due
+        advanceClock(currentTick());
 
         // Choose next process to run from the scheduler
         currentProcessPcb = scheduler();
+
+        // Set the timer for the clock. While other processes are waiting to run,
+        // the process that was chosen is preempted at the next tick. Otherwise, 
+        // with tickless idle, the timer is set for when the next sleeping process
+        // wakes up (or stopped if none is sleeping)
+        int waiting = highPriorityQueue.length + middlePriorityQueue.length + 
+            lowPriorityQueue.length;
+        if (TICKLESS_IDLE && waiting == 0)
+            setTimer(nextWakeTick());
+        else
+            setTimer(clockTicks + 1);
+
         // If scheduler function returns null, schedule idle process
         if (currentProcessPcb == NULL) {
             // Set currentProcessPid
@@ -223,11 +240,10 @@ int main(void) {
 
         // Print all processes
         // printf("All processes:\n");
-        // currNode = processTable -> head;
-        // while (currNode != NULL) {
-        //     pcb *currPcb = (pcb*)(currNode -> payload);
+        // for (int pid = 1; pid < processTableSize; pid++) {
+        //     pcb *currPcb = processTable[pid];
+        //     if (currPcb == NULL) continue;
         //     printf("pid: %d, ppid: %d, priority: %d, state: %d\n", currPcb->pid, currPcb->ppid, currPcb->priority, currPcb->state);
-        //     currNode = currNode -> next;
         //     printf("\n");
         // }
     }
@@ -242,11 +258,9 @@ int main(void) {
     //     pcb *currPcb = (pcb*)(currNode -> payload);
     //     printf("pid: %d, ppid: %d, priority: %d, state: %d\n", currPcb->pid, currPcb->ppid, currPcb->priority, currPcb->state);
     //     printf("Fd Table:\n");
-    //     lNode *node = currPcb -> fdTable -> head;
-    //     while (node != NULL) {
-    //         fdEntry *entry = (fdEntry*)(node -> payload);
-    //         printf("fd: %d, file: %s, mode: %d, loc: %u\n", entry -> fd, entry -> fileName, entry -> mode, entry -> loc);
-    //         node = node -> next;
+    //     for (int fd = 0; fd < currPcb -> fds -> size; fd++) {
+    //         if (getFdDesc(currPcb, fd) != -1)
+    //             printf("fd: %d, desc: %d\n", fd, getFdDesc(currPcb, fd));
     //     }
     //     currNode = currNode -> next;
     //     printf("\n");
@@ -4,6 +4,7 @@
 #include <ucontext.h>
 #include <stdint.h>
 #include "linkedList.h"
+#include "fat_fs/headers.h"
 
 // Definitions for integer encodings of process states
 #define RUNNING_STATE 0
@@ -36,6 +37,35 @@
 #define STACK_SIZE 10000000
 // Definition for the pid of the shell process, which is always 1
 #define SHELL_PID 1
+// Definition for the length of a clock tick (in microseconds)
+#define TICK_LENGTH 100000
+// Definition for whether the timer for the system clock is only set to expire at
+// every tick while processes are waiting to run (1), or at every tick always (0).
+// With tickless idle, a process that runs alone is not preempted, and while 
+// every process is blocked the timer is set to expire when the next sleeping 
+// process wakes up
+#define TICKLESS_IDLE 1
+// Definition for the number of file descriptors a new file descriptor table has
+// room for (must be a multiple of 64)
+#define FD_TABLE_INITIAL_SIZE 64
+
+// Definition of struct for a file descriptor table. File descriptor 0 is for the 
+// process's input file, and 1 is for the process's output file. fd is open iff
+// bit fd of the bitmap is set
+typedef struct fdTable {
+    int *descs; // Array indexed by fd of the open file descriptions the file 
+                // descriptors point to (indices in the open file description table)
+    uint64_t *bitmap; // Bitmap of the open file descriptors, one bit per fd
+    int size; // Number of file descriptors the table has room for (a multiple of 64)
+} fdTable;
+
+// Definition of struct for a scheduler queue. The queue is linked through the
+// PCBs it holds, so adding a process to it or removing one does not allocate
+typedef struct runQueue {
+    struct pcb *head;
+    struct pcb *tail;
+    int length;
+} runQueue;
 
 // Definition of struct for a PCB
 typedef struct pcb {
@@ -43,38 +73,65 @@ typedef struct pcb {
     int pid;
     int ppid;
     linkedList *childPids; // Pointer to list of the children's pids. 
-    linkedList *fdTable; // Pointer to file descriptor table, implemented as a 
-                         // list of file descriptor entries
+    fdTable *fds; // Pointer to the file descriptor table
     int priority; // Priority level of the process (-1, 0, or 1)
     int state; // State of the process (running, zombie, etc)
     // List of stateChange structs to keep track of the state changes of the 
     // process's children. This list is used by the waitpid function to check
     // whether the children have undergone a state change to report
     linkedList *stateChanges; 
+    runQueue *queue; // Scheduler queue the process is in (NULL if it is in none)
+    struct pcb *queuePrev; // Previous process in the scheduler queue
+    struct pcb *queueNext; // Next process in the scheduler queue
+    int sleeping; // Whether the process is in the timer wheel (1) or not (0)
+    unsigned long wakeTick; // Clock tick at which the process stops sleeping
+    struct pcb *sleepPrev; // Previous process in the same slot of the timer wheel
+    struct pcb *sleepNext; // Next process in the same slot of the timer wheel
 } pcb;
 
-// Definition of struct for entries of a file descriptor table
-typedef struct fdEntry {
-    int fd; // The file descriptor. File descriptor 0 is for the process's input
-            // file, and 1 is for the process's output file
-    char *fileName; // The file name of the file associated with fd. If the fd is 
-                    // associated with stdin/stdout, the fileName will be stdin/
-                    // stdout, respectively. 
+// Definitions for the types of open file descriptions
+#define STDIN_DESC 0 // Reads from the terminal
+#define STDOUT_DESC 1 // Writes to the terminal
+#define FILE_DESC 2 // Reads and writes a file in the FAT filesystem
+
+// Definition of struct for entries of the open file table. There is one entry for
+// each file in the FAT filesystem that is open, shared by all the open file 
+// descriptions of the file
+typedef struct openFile {
+    int refCount; // Number of open file descriptions of the file (0 if this entry
+                  // is unused)
+    fileHandle handle; // Handle on the file. handle.entryOffset identifies the file
+    int numWriters; // Number of open file descriptions with mode F_WRITE
+    int unlinked; // Whether the file was deleted while open. Its directory entry 
+                  // and blocks are freed when refCount drops to 0
+} openFile;
+
+// Definition of struct for entries of the open file description table. An open 
+// file description is created by each f_open, and is shared by the file 
+// descriptors duplicated from it (by dup2 or by spawning a process), so that they
+// share the file offset
+typedef struct openFileDesc {
+    int refCount; // Number of file descriptors referring to the description (0 
+                  // if this entry is unused)
+    int type; // STDIN_DESC, STDOUT_DESC, or FILE_DESC
+    int file; // Index of the file in the open file table (FILE_DESC only)
     int mode; // Mode in which the file is opened (F_WRITE, F_READ, or F_APPEND)
     uint32_t loc; // The current location we are at in the file (for reading, writing,
              // seeking, etc)
-} fdEntry;
-// TODO: CHANGE ALL THE FUNCTIONS INVOLVING FDENTRY TO MATCH THE FOLLOWING:
-// Add the following fields to fdEntry: 
-// mode: The mode in which the file is opened
-// loc: The current location we are at in the file (for reading, writing, seeking, etc)
+    fileHandle handle; // This description's own handle on the file, whose cursor 
+                       // follows loc
+} openFileDesc;
+
+// Definition for the number of slots in the timer wheel
+#define TIMER_WHEEL_SLOTS 256
 
-// Definition for struct for entries of the sleepBlocked list
-typedef struct sleepBlockedEntry {
-    int pid; // The pid of the blocked process
-    int ticks; // The number of clock ticks remaining until the process becomes 
-               // unblocked
-} sleepBlockedEntry;
+// Definition of struct for a slot of the timer wheel, which holds the sleeping 
+// processes whose wake tick is the slot's index modulo TIMER_WHEEL_SLOTS. The slot
+// is linked through the PCBs it holds, in the order the processes went to sleep
+typedef struct timerSlot {
+    struct pcb *head;
+    struct pcb *tail;
+} timerSlot;
 
 // Definition of struct for elements of the stateChanges list
 typedef struct stateChange {
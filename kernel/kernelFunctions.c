@@ -3,23 +3,57 @@
 #include <ucontext.h>
 #include <string.h>
 #include <time.h>
+#include <sys/time.h>
 #include "linkedList.h"
 #include "kernel.h"
 #include "kernelFunctions.h"
+#include "fat_fs/headers.h"
+#include "fat_fs/touch.h"
+#include "fileTable.h"
 
 // Variables for the scheduler queues. The scheduler queues are queues of 
-// pids
-linkedList *lowPriorityQueue;
-linkedList *middlePriorityQueue;
-linkedList *highPriorityQueue;
+// PCBs, linked through the PCBs themselves
+runQueue lowPriorityQueue;
+runQueue middlePriorityQueue;
+runQueue highPriorityQueue;
+// Definitions for the scheduler's weights of the priority levels. Over any 19 
+// consecutive choices while all the queues are non-empty, the high, medium, and 
+// low priority queues are picked exactly 9, 6, and 4 times respectively
+#define HIGH_WEIGHT 9
+#define MED_WEIGHT 6
+#define LOW_WEIGHT 4
+// Variable for the credit of each scheduler queue (indexed by priority + 1), used
+// by the scheduler to share out the choices according to the weights
+int queueCredits[3];
 // Variables for blocked lists. 
 linkedList *waitpidBlocked; // List of pids of processes blocked on a waitpid call.
-linkedList *sleepBlocked; // List of processes blocked on a sleep call. Is a list
-                          // of sleepBlockedEntry entries. 
-
-
-// Variable for the process table (implemented as a list of PCBs)
-linkedList *processTable;
+// Variable for the timer wheel, which holds the processes blocked on a sleep 
+// call. A process that sleeps until tick t is put in slot t % TIMER_WHEEL_SLOTS,
+// so each clock tick only looks at the processes in one slot
+timerSlot timerWheel[TIMER_WHEEL_SLOTS];
+// Variable for the number of sleeping processes in the timer wheel
+int numSleeping = 0;
+// Variable for the number of clock ticks the kernel has processed since the 
+// system clock started
+unsigned long clockTicks = 0;
+// Variable for the time at which the system clock started (ie: the start of tick
+// 0). Tick t starts t * TICK_LENGTH microseconds later
+struct timespec clockStart;
+// Variable for the tick the timer for the system clock is set to expire at, or 0
+// if the timer is not set
+unsigned long timerTick = 0; 
+
+
+// Variables for the process table, which is indexed by pid. Entry pid is the 
+// PCB of the process with that pid, or NULL if no process has it (pid 0 is never
+// allocated). The table doubles in size when it is half full
+pcb **processTable = NULL;
+int processTableSize = 0;
+int numProcesses = 0;
+// Definition for the initial size of the process table. Pids are recycled once
+// the processes that had them have been cleaned up, but not before the pids 
+// have gone all the way around the table
+#define INITIAL_PROCESS_TABLE_SIZE 1024
 // Variable for the ucontext of the kernel thread
 ucontext_t *kernelContext;
 // Variable for the ucontext of a new process that is going to be created. 
@@ -32,10 +66,10 @@ ucontext_t *kernelContext;
 ucontext_t *newContext;
 // Variable that is a pointer to the ucontext for the idle process
 ucontext_t *idleProcessContext;
-// Variable to keep track of the current highest pid that has been allocated. 
-// When a new pid needs to be allocated, we simply allocate highestPid + 1 to
-// the new process and increment highestPid
-int highestPid = 0;
+// Variable for the pid to start the search for an unused pid at. It is the pid
+// after the last one allocated, so pids are allocated in increasing order until
+// they wrap around the process table
+int nextPid = 1;
 // Variable that is the pcb of the currently running process. If the idle process
 // is running, it will be null
 pcb *currentProcessPcb = NULL;
@@ -45,6 +79,9 @@ int currentProcessPid = -1;
 // Variable that is the pid of the process that currently has terminal control (ie: 
 // the process that is currently the foreground process)
 int foregroundProcessPid = -1;
+// Variable that is the filesystem mounted by the kernel. All file operations of
+// user level processes act on this filesystem
+fileSystem *mountedFs = NULL;
 
 
 
@@ -62,30 +99,17 @@ pcb *k_process_create(pcb *parentPcb) {
     // Create a new pcb entry for the child 
     pcb *newPcb = malloc(sizeof(pcb));
     newPcb -> uc = newContext;
-    newPcb -> pid = (highestPid++) + 1;
+    newPcb -> pid = allocatePid();
     newPcb -> ppid = parentPcb -> pid;
     newPcb -> childPids = createList();
     // Create a new fd table for the child that is a copy of the parent's fd table
-    linkedList *fdTable = createList();
-    lNode *currNode = parentPcb -> fdTable -> head;
-    while (currNode != NULL) {
-        fdEntry *newEntry = malloc(sizeof(fdEntry));
-        fdEntry *oldEntry = (fdEntry*)(currNode -> payload);
-        // Copy the contents from oldEntry to newEntry
-        newEntry -> fd = oldEntry -> fd;
-        char *str = malloc(strlen(oldEntry -> fileName));
-        strcpy(str, oldEntry -> fileName);
-        newEntry -> fileName = str;
-        newEntry -> mode = oldEntry -> mode;
-        newEntry -> loc = oldEntry -> loc;
-        // Add entry to fdTable
-        addNodeTail(fdTable, newEntry);
-        currNode = currNode -> next;
-    }
-    newPcb -> fdTable = fdTable;
+    newPcb -> fds = copyFdTable(parentPcb -> fds);
     newPcb -> priority = parentPcb -> priority; // Child inherits parent's priority
     newPcb -> state = RUNNING_STATE;
     newPcb -> stateChanges = createList();
+    newPcb -> queue = NULL; // Not in a scheduler queue until it is added below
+    newPcb -> queuePrev = newPcb -> queueNext = NULL;
+    newPcb -> sleeping = 0;
 
     // Add the child to the parent PCB's childPids list
     int *pidPtr = malloc(sizeof(int)); // Pointer to newPcb's pid 
@@ -93,10 +117,11 @@ pcb *k_process_create(pcb *parentPcb) {
     addNodeTail(parentPcb -> childPids, pidPtr);
 
     // Add newPcb to the process table
-    addNodeTail(processTable, newPcb);
+    processTable[newPcb -> pid] = newPcb;
+    numProcesses += 1;
 
     // Add the newly created process to the appropriate scheduler queue
-    addToScheduler(newPcb -> pid, newPcb -> priority);
+    addToScheduler(newPcb);
 
     return newPcb;
 } 
@@ -114,31 +139,20 @@ pcb *k_process_create(pcb *parentPcb) {
 pcb *k_process_create2(int ppid, int priority, int state) {
     pcb *newPcb = malloc(sizeof(pcb));
     newPcb -> uc = newContext;
-    newPcb -> pid = (highestPid++) + 1;
+    newPcb -> pid = allocatePid();
     newPcb -> ppid = ppid;
     newPcb -> childPids = createList();
-    // Initialize the fdTable with the standard file descriptors 0 and 1 for 
+    // Initialize the fd table with the standard file descriptors 0 and 1 for 
     // stdin and stdout, respectively
-    newPcb -> fdTable = createList();
-    fdEntry *entry = malloc(sizeof(fdEntry));
-    char *fileName = malloc(strlen("stdin") + 1);
-    strcpy(fileName, "stdin");
-    entry -> fd = 0;
-    entry -> fileName = fileName;
-    entry -> mode = F_READ;
-    entry -> loc = 0;
-    addNodeTail(newPcb -> fdTable, entry);
-    entry = malloc(sizeof(fdEntry));
-    fileName = malloc(strlen("stdout") + 1);
-    strcpy(fileName, "stdout");
-    entry -> fd = 1;
-    entry -> fileName = fileName;
-    entry -> mode = F_WRITE;
-    entry -> loc = 0;
-    addNodeTail(newPcb -> fdTable, entry);
+    newPcb -> fds = createFdTable();
+    setFd(newPcb, 0, openStdDesc(STDIN_DESC));
+    setFd(newPcb, 1, openStdDesc(STDOUT_DESC));
     newPcb -> priority = priority;
     newPcb -> state = state;
     newPcb -> stateChanges = createList();
+    newPcb -> queue = NULL; // Not in a scheduler queue until it is added below
+    newPcb -> queuePrev = newPcb -> queueNext = NULL;
+    newPcb -> sleeping = 0;
     // Add the child to the parent PCB's childPids list if parent exists
     pcb *parentPcb = findProcess(ppid);
     if (parentPcb != NULL) {
@@ -148,17 +162,19 @@ pcb *k_process_create2(int ppid, int priority, int state) {
     }
 
     // Add newPcb to the process table
-    addNodeTail(processTable, newPcb);
+    processTable[newPcb -> pid] = newPcb;
+    numProcesses += 1;
 
     // Add the newly created process to the appropriate scheduler queue
-    addToScheduler(newPcb -> pid, newPcb -> priority);
+    addToScheduler(newPcb);
 
     return newPcb;
 }
 
 
 // Function to create a new entry in the file descriptor table for a specified
-// process. Assumes the specified process is valid
+// process. Assumes the specified process is valid. Does nothing if fileName does
+// not exist
 // Arguments: 
 //     pid: pid of the process whose file descriptor table to add the entry to 
 //     fd: The file descriptor of the new entry 
@@ -169,37 +185,156 @@ pcb *k_process_create2(int ppid, int priority, int state) {
 void createFdEntry(int pid, int fd, char *fileName, int mode) {
     // Get pcb of the process
     pcb *processPcb = findProcess(pid);
-    // Malloc a new fdEntry and string and copy over fileName to the newly malloc'd
-    // string
-    fdEntry *entry = malloc(sizeof(fdEntry));
-    char *name = malloc(strlen(fileName) + 1);
-    strcpy(name, fileName);
-    // Initalize entry fields
-    entry -> fd = fd;
-    entry -> fileName = name;
-    entry -> mode = mode;
-    entry -> loc = 0;
-    // Add entry to file descriptor table
-    addNodeTail(processPcb -> fdTable, entry);
+    // Create a new open file description for fileName
+    int desc = openDesc(fileName, mode);
+    if (desc == -1) return;
+    // Point fd to the new description, closing fd first if it is open
+    if (getFdDesc(processPcb, fd) != -1) 
+        releaseDesc(getFdDesc(processPcb, fd));
+    setFd(processPcb, fd, desc);
+}
+
+
+// Function to create an empty file descriptor table
+// Arguments: 
+//     None 
+// Returns: 
+//     A pointer to the new file descriptor table
+fdTable *createFdTable(void) {
+    fdTable *table = malloc(sizeof(fdTable));
+    table -> size = FD_TABLE_INITIAL_SIZE;
+    table -> descs = malloc(table -> size * sizeof(int));
+    table -> bitmap = calloc(table -> size / 64, sizeof(uint64_t));
+
+    return table;
+}
+
+
+// Function to copy a file descriptor table. The file descriptors of the copy 
+// share the open file descriptions of the original
+// Arguments: 
+//     table: The file descriptor table to copy 
+// Returns: 
+//     A pointer to the copy
+fdTable *copyFdTable(fdTable *table) {
+    fdTable *copy = malloc(sizeof(fdTable));
+    copy -> size = table -> size;
+    copy -> descs = malloc(copy -> size * sizeof(int));
+    copy -> bitmap = malloc(copy -> size / 64 * sizeof(uint64_t));
+    memcpy(copy -> descs, table -> descs, copy -> size * sizeof(int));
+    memcpy(copy -> bitmap, table -> bitmap, copy -> size / 64 * sizeof(uint64_t));
+
+    // Add a reference to each open file description for the copy
+    for (int i = 0; i < copy -> size / 64; i++) {
+        uint64_t word = copy -> bitmap[i];
+        while (word != 0) {
+            retainDesc(copy -> descs[i * 64 + __builtin_ctzll(word)]);
+            word &= word - 1; // Clear the lowest set bit
+        }
+    }
+
+    return copy;
+}
+
+
+// Function to free a file descriptor table. Does not release the open file 
+// descriptions its file descriptors point to (see closeFdTable)
+// Arguments: 
+//     table: The file descriptor table to free 
+// Returns: 
+//     None
+void freeFdTable(fdTable *table) {
+    free(table -> descs);
+    free(table -> bitmap);
+    free(table);
+}
+
+
+// Function to get the open file description a file descriptor points to
+// Arguments: 
+//     processPcb: The pcb of the process the file descriptor belongs to 
+//     fd: The file descriptor 
+// Returns: 
+//     Index of the open file description, or -1 if fd is not open
+int getFdDesc(pcb *processPcb, int fd) {
+    fdTable *table = processPcb -> fds;
+    if (fd < 0 || fd >= table -> size) return -1;
+    if (!(table -> bitmap[fd / 64] & (1ULL << (fd % 64)))) return -1;
+
+    return table -> descs[fd];
+}
+
+
+// Function to make a file descriptor point to an open file description, growing
+// the file descriptor table if needed. Does not release the description fd 
+// pointed to before, if any
+// Arguments: 
+//     processPcb: The pcb of the process the file descriptor belongs to 
+//     fd: The file descriptor (must not be negative)
+//     desc: Index of the open file description 
+// Returns: 
+//     None
+void setFd(pcb *processPcb, int fd, int desc) {
+    fdTable *table = processPcb -> fds;
+    if (fd >= table -> size) {
+        // Grow the table to the next multiple of 64 that is at least double its
+        // size and has room for fd
+        int newSize = table -> size * 2;
+        if (newSize <= fd) newSize = (fd / 64 + 1) * 64;
+        table -> descs = realloc(table -> descs, newSize * sizeof(int));
+        table -> bitmap = realloc(table -> bitmap, newSize / 64 * sizeof(uint64_t));
+        memset(table -> bitmap + table -> size / 64, 0, (newSize - table -> size) / 64 * sizeof(uint64_t));
+        table -> size = newSize;
+    }
+    table -> descs[fd] = desc;
+    table -> bitmap[fd / 64] |= 1ULL << (fd % 64);
 }
 
 
-// Function to obtain a new file descriptor. Returns the smallest integer greater
-// than all currently open file descriptors
+// Function to remove a file descriptor from a file descriptor table. Does not 
+// release the open file description it points to
+// Arguments: 
+//     processPcb: The pcb of the process the file descriptor belongs to 
+//     fd: The file descriptor, which must be open
+// Returns: 
+//     None
+void removeFd(pcb *processPcb, int fd) {
+    processPcb -> fds -> bitmap[fd / 64] &= ~(1ULL << (fd % 64));
+}
+
+
+// Function to obtain a new file descriptor. Returns the smallest file descriptor
+// that is not open, so closed file descriptors are reused
 // Arguments: 
 //     processPcb: The pcb of the process for which to get the new file descriptor 
 // Returns: 
 //     An integer that is the minimum unused file descriptor
 int getNewFd(pcb *processPcb) {
-    int fd = 0;
-    lNode *currNode = processPcb -> fdTable -> head;
-    while (currNode != NULL) {
-        fdEntry *entry = (fdEntry*)(currNode -> payload);
-        fd = ((entry -> fd) > fd) ? entry -> fd : fd;
-        currNode = currNode -> next;
+    fdTable *table = processPcb -> fds;
+    for (int i = 0; i < table -> size / 64; i++) {
+        if (~(table -> bitmap[i]) != 0) 
+            return i * 64 + __builtin_ctzll(~(table -> bitmap[i]));
     }
 
-    return fd + 1;
+    // Every file descriptor in the table is open, so the table will grow
+    return table -> size;
+}
+
+
+// Function to close all the file descriptors of a process, releasing the open 
+// file descriptions they point to
+// Arguments: 
+//     processPcb: The pcb of the process whose file descriptors to close 
+// Returns: 
+//     None
+void closeFdTable(pcb *processPcb) {
+    fdTable *table = processPcb -> fds;
+    for (int i = 0; i < table -> size / 64; i++) {
+        while (table -> bitmap[i] != 0) {
+            releaseDesc(table -> descs[i * 64 + __builtin_ctzll(table -> bitmap[i])]);
+            table -> bitmap[i] &= table -> bitmap[i] - 1; // Clear the lowest set bit
+        }
+    }
 }
 
 
@@ -226,7 +361,7 @@ int k_process_kill(pcb *processPcb, int signal) {
         // Change the process state
         processPcb -> state = STOPPED_STATE;
         // Remove the process from its scheduler queue
-        removeFromScheduler(pid, processPcb -> priority);
+        removeFromScheduler(processPcb);
         // Add this state change to the parent process's stateChanges list
         addStateChange(processPcb -> ppid, pid, STOP_CHANGE);
         // Unblock parent process if it exists and is in waitpidBlocked
@@ -242,7 +377,7 @@ int k_process_kill(pcb *processPcb, int signal) {
             unblockProcess(processPcb -> ppid);
         // Change the process state
         // If the process is blocked, change its state to blocked
-        if (isWaitpidBlocked(pid) || isSleepBlocked(pid)) {
+        if (isWaitpidBlocked(pid) || processPcb -> sleeping) {
             processPcb -> state = BLOCKED_STATE;
             return 0;
         } 
@@ -250,14 +385,14 @@ int k_process_kill(pcb *processPcb, int signal) {
         // to the appropriate scheduler queue
         if (findProcess(processPcb -> ppid) == NULL && (processPcb -> ppid) != -1) {
             processPcb -> state = ORPHANED_STATE;
-            addToScheduler(pid, processPcb -> priority);
+            addToScheduler(processPcb);
             return 0;
         }
         // If we get here, we know the process's state should now be running state
         processPcb -> state = RUNNING_STATE;
         // Put process back in the appropriate scheduler queue if state is now
         // orphaned or running
-        addToScheduler(pid, processPcb -> priority);
+        addToScheduler(processPcb);
     } else if (signal == S_SIGTERM) { // Kill the process 
         terminateProcess(pid, TERM_CHANGE);
     }
@@ -282,9 +417,13 @@ int terminateProcess(int pid, int type) {
     if (processPcb == NULL) return -1;
 
     // Remove the process from scheduler and blocked queues
-    removeFromScheduler(pid, processPcb -> priority);
+    removeFromScheduler(processPcb);
     removeFromBlockedList(pid, waitpidBlocked);
-    removeFromBlockedList(pid, sleepBlocked);
+    removeFromTimerWheel(processPcb);
+
+    // Close the process's file descriptors, so that the files it had open are 
+    // released even while it is a zombie
+    closeFdTable(processPcb);
 
     // Call k_process_cleanup on the zombie children of the process by iterating
     // through the process's stateChanges list and searching for those processes
@@ -299,11 +438,14 @@ int terminateProcess(int pid, int type) {
     }
 
     // Change the state of the remaining children of the process to orphaned, if 
-    // they are not blocked or stopped (we already the removed the zombied children)
+    // they are not blocked or stopped (we already the removed the zombied children).
+    // The children are also given ppid 0, which no process has, so that they 
+    // stay orphans once the process's pid is recycled
     currNode = processPcb -> childPids -> head;
     while (currNode != NULL) {
         int childPid = *((int*)(currNode -> payload));
         pcb *childPcb = findProcess(childPid);
+        childPcb -> ppid = 0;
         if ((childPcb -> state) != BLOCKED_STATE && (childPcb -> state) != STOPPED_STATE)
             childPcb -> state = ORPHANED_STATE;
         currNode = currNode -> next;
@@ -331,10 +473,10 @@ int terminateProcess(int pid, int type) {
 // process exists and is not zombied
 // Arguments: 
 //     pid: pid of the process to block 
-//     list: The blocked list in which to put the process (ie: sleepBlocked or 
-//     waitpidBlocked)
-//     ticks: If list is sleepBlocked, then this argument will be used to determine
-//     how many ticks to block the process for
+//     list: The blocked list in which to put the process (ie: waitpidBlocked), or
+//     NULL to put the process in the timer wheel (ie: the process is sleeping)
+//     ticks: If list is NULL, then this argument will be used to determine how 
+//     many ticks to block the process for
 // Returns: 
 //     None
 void blockProcess(int pid, linkedList *list, int ticks) {
@@ -342,7 +484,7 @@ void blockProcess(int pid, linkedList *list, int ticks) {
     // Set process state to blocked
     processPcb -> state = BLOCKED_STATE;
     // Remove process from scheduler queue
-    removeFromScheduler(pid, processPcb -> priority);
+    removeFromScheduler(processPcb);
     //  Put process in appropriate blocked queue
     if (list == waitpidBlocked) {
         int *temp = malloc(sizeof(int)); // Create int as payload for the node to be
@@ -350,10 +492,7 @@ void blockProcess(int pid, linkedList *list, int ticks) {
         *temp = pid;
         addNodeTail(list, temp);
     } else {
-        sleepBlockedEntry *entry = malloc(sizeof(sleepBlockedEntry));
-        entry -> pid = pid;
-        entry -> ticks = ticks;
-        addNodeTail(list, entry);
+        addToTimerWheel(processPcb, ticks);
     }
 }
 
@@ -370,18 +509,18 @@ int unblockProcess(int pid) {
     if (processPcb == NULL) return -1;
     // Remove process from blocked queue
     removeFromBlockedList(pid, waitpidBlocked);
-    removeFromBlockedList(pid, sleepBlocked);
+    removeFromTimerWheel(processPcb);
     // Restore the appropriate state of the process (either stopped, running,
     // or orphaned), and add to scheduler queue if necessary
     if (processPcb -> state == STOPPED_STATE) return 0; 
     if (findProcess(processPcb -> ppid) == NULL && (processPcb -> ppid) != -1) { // Process is an orphan
         processPcb -> state = ORPHANED_STATE;
-        addToScheduler(pid, processPcb -> priority);
+        addToScheduler(processPcb);
         return 0;
     }
     // If we get here, the process must now be in the running state
     processPcb -> state = RUNNING_STATE;
-    addToScheduler(pid, processPcb -> priority);
+    addToScheduler(processPcb);
 
     return 0;
 }
@@ -454,20 +593,163 @@ int isWaitpidBlocked(int pid) {
 }
 
 
-// Function to check if the specified process is in the sleepBlocked list
+// Function to put a process in the timer wheel, so that it is unblocked once
+// the specified number of clock ticks have elapsed. The ticks are counted from 
+// the current tick of the system clock, which may be ahead of the ticks the 
+// kernel has processed. Assumes the process is not already in the timer wheel
 // Arguments: 
-//     pid: pid of the process to check 
+//     process: PCB of the process to put in the timer wheel 
+//     ticks: The number of clock ticks the process sleeps for (at least 1 tick 
+//     is used)
 // Returns: 
-//     1 if the process is in sleepBlocked, 0 otherwise 
-int isSleepBlocked(int pid) {
-    lNode *currNode = sleepBlocked -> head;
-    while (currNode != NULL) {
-        sleepBlockedEntry *entry = (sleepBlockedEntry*)(currNode -> payload);
-        if ((entry -> pid) == pid) return 1;
-        currNode = currNode -> next;
-    } 
+//     None
+void addToTimerWheel(pcb *process, int ticks) {
+    if (ticks < 1) ticks = 1;
+    unsigned long now = currentTick();
+    if (now < clockTicks) now = clockTicks;
+    process -> wakeTick = now + ticks;
+    timerSlot *slot = &timerWheel[process -> wakeTick % TIMER_WHEEL_SLOTS];
+
+    // Link the process in at the tail of its slot
+    process -> sleeping = 1;
+    numSleeping += 1;
+    process -> sleepPrev = slot -> tail;
+    process -> sleepNext = NULL;
+    if (slot -> tail != NULL)
+        slot -> tail -> sleepNext = process;
+    else
+        slot -> head = process;
+    slot -> tail = process;
+}
 
-    return 0;
+
+// Function to remove a process from the timer wheel. If the process is not in
+// the timer wheel, the function does nothing
+// Arguments: 
+//     process: PCB of the process to remove from the timer wheel 
+// Returns: 
+//     None
+void removeFromTimerWheel(pcb *process) {
+    if (!(process -> sleeping)) return;
+    timerSlot *slot = &timerWheel[process -> wakeTick % TIMER_WHEEL_SLOTS];
+
+    // Unlink the process from its neighbors in the slot
+    if (process -> sleepPrev != NULL)
+        process -> sleepPrev -> sleepNext = process -> sleepNext;
+    else
+        slot -> head = process -> sleepNext;
+    if (process -> sleepNext != NULL)
+        process -> sleepNext -> sleepPrev = process -> sleepPrev;
+    else
+        slot -> tail = process -> sleepPrev;
+    process -> sleeping = 0;
+    numSleeping -= 1;
+    process -> sleepPrev = process -> sleepNext = NULL;
+}
+
+
+// Function to process the ticks of the system clock up to the specified tick. 
+// For each tick, unblocks the processes in the timer wheel whose wake tick has 
+// been reached, in the order they went to sleep. Processes in the same slot that
+// sleep until a later turn of the wheel are left alone
+// Arguments: 
+//     tick: The tick to process the ticks up to (usually the current tick of the
+//     system clock)
+// Returns: 
+//     None
+void advanceClock(unsigned long tick) {
+    while (clockTicks < tick) {
+        clockTicks += 1;
+        pcb *process = timerWheel[clockTicks % TIMER_WHEEL_SLOTS].head;
+        while (process != NULL) {
+            pcb *next = process -> sleepNext; // process leaves the slot if unblocked
+            if (process -> wakeTick <= clockTicks)
+                unblockProcess(process -> pid);
+            process = next;
+        }
+    }
+}
+
+
+// Function to find the next tick at which a sleeping process wakes up. Only 
+// looks one turn of the timer wheel ahead, so if no process wakes up within 
+// that turn, the tick at the end of the turn is returned instead
+// Arguments: 
+//     None
+// Returns: 
+//     The next tick at which a process in the timer wheel wakes up (or the tick 
+//     at the end of the current turn of the wheel), or 0 if no process is 
+//     sleeping
+unsigned long nextWakeTick(void) {
+    if (numSleeping == 0) return 0;
+
+    for (unsigned long tick = clockTicks + 1; tick < clockTicks + TIMER_WHEEL_SLOTS; tick++) {
+        pcb *process = timerWheel[tick % TIMER_WHEEL_SLOTS].head;
+        while (process != NULL) {
+            if (process -> wakeTick <= tick) return tick;
+            process = process -> sleepNext;
+        }
+    }
+
+    return clockTicks + TIMER_WHEEL_SLOTS;
+}
+
+
+// Function to start the system clock at tick 0. The timer for the system clock 
+// is not set until setTimer is called
+// Arguments: 
+//     None
+// Returns: 
+//     None
+void startClock(void) {
+    clock_gettime(CLOCK_MONOTONIC, &clockStart);
+    clockTicks = 0;
+}
+
+
+// Function to get the current tick of the system clock, ie: the number of whole 
+// ticks that have elapsed since the clock started
+// Arguments: 
+//     None
+// Returns: 
+//     The current tick
+unsigned long currentTick(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long long elapsed = (now.tv_sec - clockStart.tv_sec) * 1000000000LL + 
+        (now.tv_nsec - clockStart.tv_nsec);
+
+    return elapsed / (TICK_LENGTH * 1000LL);
+}
+
+
+// Function to set the timer for the system clock to expire once, at the start 
+// of the specified tick. A SIGALRM is delivered when the timer expires
+// Arguments: 
+//     tick: The tick at whose start the timer expires, or 0 to stop the timer
+// Returns: 
+//     None
+void setTimer(unsigned long tick) {
+    struct itimerval timer;
+    timer.it_interval.tv_sec = 0;
+    timer.it_interval.tv_usec = 0;
+    timer.it_value.tv_sec = 0;
+    timer.it_value.tv_usec = 0;
+    if (tick != 0) {
+        // Get the time until the start of the tick, rounding up so that the timer
+        // does not expire before the tick starts (it must be at least 1 
+        // microsecond, because a time of 0 stops the timer)
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long long remaining = tick * (TICK_LENGTH * 1000LL) - 
+            ((now.tv_sec - clockStart.tv_sec) * 1000000000LL + (now.tv_nsec - clockStart.tv_nsec));
+        long long usec = (remaining + 999) / 1000;
+        if (usec < 1) usec = 1;
+        timer.it_value.tv_sec = usec / 1000000;
+        timer.it_value.tv_usec = usec % 1000000;
+    }
+    setitimer(ITIMER_REAL, &timer, NULL);
+    timerTick = tick;
 }
 
 
@@ -481,14 +763,8 @@ void removeFromBlockedList(int pid, linkedList *blockedList) {
     // Try to remove the process from blockedList
     lNode *currNode = blockedList -> head;
     while (currNode != NULL) {
-        if (blockedList == waitpidBlocked) {
-            if (*((int*)(currNode -> payload)) == pid) 
-                removeNode(blockedList, currNode);
-        } else {
-            sleepBlockedEntry *entry = (sleepBlockedEntry*)(currNode -> payload);
-            if ((entry -> pid) == pid)
-                removeNode(blockedList, currNode);
-        }
+        if (*((int*)(currNode -> payload)) == pid) 
+            removeNode(blockedList, currNode);
         currNode = currNode -> next;
     }
 }
@@ -508,39 +784,59 @@ void removeFromBlockedList(int pid, linkedList *blockedList) {
 void k_process_cleanup(pcb *processPcb) {
     // Remove process from parent's childPids list if parent still exists
     int pid = processPcb -> pid;
-    int ppid = processPcb -> ppid;
-    lNode *currNode = processTable -> head;
-    while (currNode != NULL) {
-        if (((pcb*)(currNode -> payload)) -> pid == ppid) { // currNode is the parent process
-                                                  // node is processTable
-            // Find the process's entry in the parent's childPids list
-            linkedList *childPids = ((pcb*)(currNode -> payload)) -> childPids;
-            currNode = childPids -> head;
-            while (currNode != NULL) {
-                if (*((int*)(currNode -> payload)) == pid) {
-                    removeNode(childPids, currNode);
-                    break;
-                }
-                currNode = currNode -> next;
+    pcb *parentPcb = getPcb(processPcb -> ppid);
+    if (parentPcb != NULL) {
+        // Find the process's entry in the parent's childPids list
+        linkedList *childPids = parentPcb -> childPids;
+        lNode *currNode = childPids -> head;
+        while (currNode != NULL) {
+            if (*((int*)(currNode -> payload)) == pid) {
+                removeNode(childPids, currNode);
+                break;
             }
-            break;
+            currNode = currNode -> next;
         }
-        currNode = currNode -> next;
     }
 
     // Free memory of the linked lists, the ucontext, and the pcb itself
     free((processPcb -> uc -> uc_stack).ss_sp); // Free thread's stack
     free(processPcb -> uc);
     freeList(processPcb -> childPids);
-    // TODO: IN THE FOLLOWING LINE, NEED TO ALSO FREE THE STRINGS IN THE FDTABLE
-    // ENTRIES THAT ARE THE FILENAME FIELDS
-    freeList(processPcb -> fdTable);
+    closeFdTable(processPcb);
+    freeFdTable(processPcb -> fds);
     freeList(processPcb -> stateChanges);
     
-    // Remove processPcb from the process table (this also frees processPcb 
-    // because processPcb is in the processTable)
-    lNode *processPcbNode = findNode(processTable, processPcb);
-    removeNode(processTable, processPcbNode);
+    // Remove processPcb from the process table, which makes its pid available
+    // again, and free processPcb
+    processTable[pid] = NULL;
+    numProcesses -= 1;
+    free(processPcb);
+}
+
+
+// Function to allocate an unused pid. Searches the process table for an unused
+// entry starting at nextPid, wrapping around to pid 1, and doubles the size of 
+// the table first if it is half full. The caller is responsible for putting the
+// new process in the table at the returned pid
+// Arguments: 
+//     None
+// Returns: 
+//     The allocated pid
+int allocatePid(void) {
+    if (numProcesses + 1 >= processTableSize / 2) {
+        int oldSize = processTableSize;
+        processTableSize = (oldSize == 0) ? INITIAL_PROCESS_TABLE_SIZE : oldSize * 2;
+        processTable = realloc(processTable, processTableSize * sizeof(pcb*));
+        memset(processTable + oldSize, 0, (processTableSize - oldSize) * sizeof(pcb*));
+    }
+
+    // The table is at most half full, so an unused entry is found quickly
+    int pid = nextPid;
+    while (pid == 0 || processTable[pid] != NULL) 
+        pid = (pid + 1) % processTableSize;
+    nextPid = (pid + 1) % processTableSize;
+
+    return pid;
 }
 
 
@@ -552,16 +848,11 @@ void k_process_cleanup(pcb *processPcb) {
 //     NULL if a process with the given pid is not present in processTable, and the
 //     appropriate pcb otherwise
 pcb *findProcess(int pid) {
-    lNode *currNode = processTable -> head;
-    pcb *currPcb;
-    while (currNode != NULL) {
-        currPcb = (pcb*)(currNode -> payload);
-        if ((currPcb -> pid) == pid && (currPcb -> state) != ZOMBIED_STATE) 
-            return currPcb;
-        currNode = currNode -> next;
-    }
+    pcb *processPcb = getPcb(pid);
+    if (processPcb == NULL || (processPcb -> state) == ZOMBIED_STATE) 
+        return NULL;
 
-    return NULL;
+    return processPcb;
 }
 
 
@@ -573,21 +864,18 @@ pcb *findProcess(int pid) {
 //     NULL if the specified process is not in the processTable, and the desired pcb
 //     otherwise
 pcb *getPcb(int pid) {
-    lNode *currNode = processTable -> head;
-    pcb *currPcb;
-    while (currNode != NULL) {
-        currPcb = (pcb*)(currNode -> payload);
-        if ((currPcb -> pid) == pid) return currPcb;
-        currNode = currNode -> next;
-    }
+    if (pid <= 0 || pid >= processTableSize) return NULL;
 
-    return NULL;
+    return processTable[pid];
 }
 
 
 // Function to implement the scheduler. The function will choose a process to 
 // run and return a pointer to its pcb. If all the queues are empty, a NULL 
 // pointer is returned, and the kernel will run the idle process in response. 
+// The choice is deterministic: the queues are picked in proportion to their 
+// weights among the queues that are non-empty, and the process at the head of
+// the picked queue is chosen. 
 // The kernel.c program will run the process chosen by the function--the function's
 // responsibility is simply to choose the process to run. NOTE: by the end of the 
 // time quantum, if the chosen process is still runnable and not terminated, the 
@@ -598,101 +886,102 @@ pcb *getPcb(int pid) {
 //     NULL if all the queues are empty, otherwise a pointer to the pcb of the 
 //     process to run
 pcb *scheduler() {
+    runQueue *queues[3] = {&highPriorityQueue, &middlePriorityQueue, &lowPriorityQueue};
+    const int weights[3] = {HIGH_WEIGHT, MED_WEIGHT, LOW_WEIGHT};
+    // Bitmask of the non-empty queues (bit priority + 1)
+    int occupied = (highPriorityQueue.length > 0) | 
+        ((middlePriorityQueue.length > 0) << 1) | ((lowPriorityQueue.length > 0) << 2);
     // Check if all scheduler queues are empty
-    if (lowPriorityQueue -> length == 0 && middlePriorityQueue -> length == 0 && highPriorityQueue -> length == 0)
+    if (occupied == 0)
         return NULL;
-    
-    int r;
-    lNode *node; 
-    pcb *processToRun;
-    int processPid;
-    
-    while (1) {
-        r = rand() % 19; // r is a random integer between 0 and 18, inclusive
-        if (r <= 3) { // Pick from the low priority queue
-            if (lowPriorityQueue -> length == 0) continue;
-            node = lowPriorityQueue -> head;
-            processPid = *((int*)(node -> payload));
-            processToRun = findProcess(processPid);
-            // Remove the chosen process from the scheduler queue
-            removeNode(lowPriorityQueue, node);
-            break;
-        } else if (r >= 4 && r <= 9) {
-            if (middlePriorityQueue -> length == 0) continue;
-            node = middlePriorityQueue -> head;
-            processPid = *((int*)(node -> payload));
-            processToRun = findProcess(processPid);
-            // Remove the chosen process from the scheduler queue
-            removeNode(middlePriorityQueue, node);
-            break;
-        } else {
-            if (highPriorityQueue -> length == 0) continue;
-            node = highPriorityQueue -> head;
-            processPid = *((int*)(node -> payload));
-            processToRun = findProcess(processPid);
-            // Remove the chosen process from the scheduler queue
-            removeNode(highPriorityQueue, node);
-            break;
+
+    // Weighted round robin: each non-empty queue gains its weight in credit, and
+    // the queue with the most credit (the highest priority one on a tie) is 
+    // picked and loses the total weight of the non-empty queues. An empty queue
+    // starts over from no credit when it becomes non-empty again
+    int chosen = -1;
+    int totalWeight = 0;
+    for (int i = 0; i < 3; i++) {
+        if ((occupied & (1 << i)) == 0) {
+            queueCredits[i] = 0;
+            continue;
         }
+        queueCredits[i] += weights[i];
+        totalWeight += weights[i];
+        if (chosen == -1 || queueCredits[i] > queueCredits[chosen]) 
+            chosen = i;
     }
+    queueCredits[chosen] -= totalWeight;
+
+    // Remove the process at the head of the chosen queue from the queue
+    pcb *processToRun = queues[chosen] -> head;
+    removeFromScheduler(processToRun);
 
     return processToRun;
 }
 
 
-// Function to add a process to an appropriate scheduler queue. Assumes specified 
-// process is runnable
+// Function to add a process to the scheduler queue for its priority. Assumes 
+// the specified process is runnable. If the process is already in a scheduler 
+// queue, the function does nothing
 // Arguments: 
-//     pid: pid of the process to be added to a scheduler queue 
-//     priority: Priority of the process 
+//     process: PCB of the process to be added to a scheduler queue 
 // Returns: 
 //     None
-void addToScheduler(int pid, int priority) {
-    linkedList *queue;
-    if (priority == LOW_PRIORITY)
-        queue = lowPriorityQueue;
-    else if (priority == MED_PRIORITY)
-        queue = middlePriorityQueue;
+void addToScheduler(pcb *process) {
+    if (process -> queue != NULL) return;
+
+    runQueue *queue;
+    if (process -> priority == LOW_PRIORITY)
+        queue = &lowPriorityQueue;
+    else if (process -> priority == MED_PRIORITY)
+        queue = &middlePriorityQueue;
     else 
-        queue = highPriorityQueue;
-    // Malloc an integer as the payload of the new node to add to the queue
-    int *payload = malloc(sizeof(int));
-    *payload = pid;
-    addNodeTail(queue, payload);
+        queue = &highPriorityQueue;
+
+    // Link the process in at the tail of the queue
+    process -> queue = queue;
+    process -> queuePrev = queue -> tail;
+    process -> queueNext = NULL;
+    if (queue -> tail != NULL)
+        queue -> tail -> queueNext = process;
+    else
+        queue -> head = process;
+    queue -> tail = process;
+    queue -> length += 1;
+
+    // With tickless idle, the timer may not be set to preempt the running 
+    // process at the next tick. If so, set it, so that the process that was just
+    // added gets to run (unless it is the running process itself)
+    if (TICKLESS_IDLE && process != currentProcessPcb && 
+        (timerTick == 0 || timerTick > clockTicks + 1))
+        setTimer(currentTick() + 1);
 }
 
 
-// Function to remove a process from the appropriate scheduler queue. If the 
-// process is not in the appropriate queue (eg: process is not runnable), the
+// Function to remove a process from the scheduler queue it is in. If the 
+// process is not in a scheduler queue (eg: process is not runnable), the 
 // function does nothing
 // Arguments: 
-//     pid: pid of the process to be removed from a scheduler queue 
-//     priority: Priority of the process 
+//     process: PCB of the process to be removed from its scheduler queue 
 // Returns: 
 //     None
-void removeFromScheduler(int pid, int priority) {
-    lNode *currNode;
-    linkedList *queue;
-    if (priority == LOW_PRIORITY) {
-        currNode = lowPriorityQueue -> head;
-        queue = lowPriorityQueue;
-    }
-    else if (priority == MED_PRIORITY) {
-        currNode = middlePriorityQueue -> head;
-        queue = middlePriorityQueue;
-    }
-    else {
-        currNode = highPriorityQueue -> head;
-        queue = highPriorityQueue;
-    }
-    while (currNode != NULL) { // Traverse the appropriate scheduler queue to 
-                               // find the process
-        if (*((int*)(currNode -> payload)) == pid) {
-            removeNode(queue, currNode);
-            break;
-        }
-        currNode = currNode -> next;
-    }
+void removeFromScheduler(pcb *process) {
+    runQueue *queue = process -> queue;
+    if (queue == NULL) return;
+
+    // Unlink the process from its neighbors in the queue
+    if (process -> queuePrev != NULL)
+        process -> queuePrev -> queueNext = process -> queueNext;
+    else
+        queue -> head = process -> queueNext;
+    if (process -> queueNext != NULL)
+        process -> queueNext -> queuePrev = process -> queuePrev;
+    else
+        queue -> tail = process -> queuePrev;
+    queue -> length -= 1;
+    process -> queue = NULL;
+    process -> queuePrev = process -> queueNext = NULL;
 }
 
 
@@ -714,7 +1003,7 @@ int k_p_nice(int pid, int priority) {
     if ((processPcb -> priority) == priority) return 0;
 
     // Remove the process from its current scheduler queue, if it is there
-    removeFromScheduler(pid, processPcb -> priority);
+    removeFromScheduler(processPcb);
 
     // Change the priority of the process in its pcb
     processPcb -> priority = priority;
@@ -722,7 +1011,7 @@ int k_p_nice(int pid, int priority) {
     // Put the process in the appropriate scheduler queue, if it is runnable
     int processState = processPcb -> state;
     if (processState == RUNNING_STATE || processState == ORPHANED_STATE) 
-        addToScheduler(pid, priority);
+        addToScheduler(processPcb);
 
     return 0;
 }
@@ -735,11 +1024,11 @@ int k_p_nice(int pid, int priority) {
 // Returns: 
 //     None 
 void k_ps(void) {
-    // Iterate through the process table
-    lNode *currNode = processTable -> head;
-    while (currNode != NULL) {
+    // Iterate through the process table in pid order
+    for (int pid = 1; pid < processTableSize; pid++) {
         // Get the pcb of the process
-        pcb *processPcb = (pcb*)(currNode -> payload);
+        pcb *processPcb = processTable[pid];
+        if (processPcb == NULL) continue;
         printf("pid: %d, ppid: %d, priority: %d, state: ", processPcb -> pid, processPcb -> ppid, processPcb -> priority);
         int state = processPcb -> state;
         if (state == RUNNING_STATE) {
@@ -753,8 +1042,6 @@ void k_ps(void) {
         } else if (state == STOPPED_STATE) {
             printf("Stopped\n");
         }
-
-        currNode = currNode -> next;
     }
 }
 
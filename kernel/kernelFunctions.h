@@ -6,21 +6,35 @@
 pcb *k_process_create(pcb *parentPcb);
 pcb *k_process_create2(int ppid, int priority, int state);
 void createFdEntry(int pid, int fd, char *fileName, int mode);
+fdTable *createFdTable(void);
+fdTable *copyFdTable(fdTable *table);
+void freeFdTable(fdTable *table);
+int getFdDesc(pcb *processPcb, int fd);
+void setFd(pcb *processPcb, int fd, int desc);
+void removeFd(pcb *processPcb, int fd);
 int getNewFd(pcb *processPcb);
+void closeFdTable(pcb *processPcb);
 int k_process_kill(pcb *processPcb, int signal);
 int terminateProcess(int pid, int type);
 void blockProcess(int pid, linkedList *list, int ticks);
 int unblockProcess(int pid);
 void addStateChange(int ppid, int pid, int changeType);
 int isWaitpidBlocked(int pid);
-int isSleepBlocked(int pid);
+void addToTimerWheel(pcb *process, int ticks);
+void removeFromTimerWheel(pcb *process);
+void advanceClock(unsigned long tick);
+unsigned long nextWakeTick(void);
+void startClock(void);
+unsigned long currentTick(void);
+void setTimer(unsigned long tick);
 void removeFromBlockedList(int pid, linkedList *blockedList);
 void k_process_cleanup(pcb *processPcb);
+int allocatePid(void);
 pcb *findProcess(int pid);
 pcb *getPcb(int pid);
 pcb *scheduler();
-void addToScheduler(int pid, int priority);
-void removeFromScheduler(int pid, int priority);
+void addToScheduler(pcb *process);
+void removeFromScheduler(pcb *process);
 int k_p_nice(int pid, int priority);
 void k_ps(void);
 
@@ -6,6 +6,7 @@
 #include "jobControl.h"
 #include "../userFunctions.h"
 #include "../kernel.h"
+#include "../fat_fs/image.h"
 
 #define PROMPT "~/$ "
 
@@ -20,6 +21,7 @@ static queue *jobQueue;
 
 extern int foregroundProcessPid;
 extern int currentProcessPid;
+extern fileSystem *mountedFs;
 
 void shell(void) {
 
@@ -55,6 +57,9 @@ void shell(void) {
         // Check for exit or job control commands
         if (argn == 1 && !strcmp(EXIT, args[0])) {
             // TODO: IMPLEMENT PROPERLY
+            // Write any FAT entries still cached in memory back to the filesystem
+            // and flush the image to disk
+            unmountImage(mountedFs);
             exit(0);
         }
         if (argn == 1 && !strcmp(JOBS, args[0])) {
@@ -7,6 +7,8 @@
 
 #define MAX_ARGS 100
 
+extern fileSystem *mountedFs;
+
 // TODO: UPDATE COMMENTS
 
 // Function to implement the shell built in cat. Is a wrapper for the FAT 
@@ -28,7 +30,7 @@ void shellCat(char *args[]) {
         fileNames[i] = args[1 + i];
     
     // Call cat function
-    cat(fileNames, n, 0, NULL);
+    cat(mountedFs, fileNames, n, 0, NULL);
 
     p_exit();
 }
@@ -102,7 +104,7 @@ void shellEcho(char *args[]) {
 // Returns: 
 //     None
 void shellLs(char *args[]) {
-    ls();
+    ls(mountedFs);
 
     p_exit();
 }
@@ -127,7 +129,7 @@ void shellTouch(char *args[]) {
         fileNames[i] = args[1 + i];
     
     // Call touch function
-    touch(fileNames, n);
+    touch(mountedFs, fileNames, n);
 
     p_exit();
 }
@@ -143,8 +145,13 @@ void shellTouch(char *args[]) {
 // Returns: 
 //     None
 void shellMv(char *args[]) {
+    // Delete dest first if it will be replaced, since mv only renames to a name
+    // that does not exist. If dest is open, its blocks are only freed once it is
+    // closed
+    if (findFile(mountedFs, args[1]) != -1 && strcmp(args[1], args[2]) != 0) 
+        f_unlink(args[2]);
     // Call mv function
-    mv(args[1], args[2]);
+    mv(mountedFs, args[1], args[2]);
 
     p_exit();
 }
@@ -161,7 +168,7 @@ void shellMv(char *args[]) {
 //     None
 void shellCp(char *args[]) {
     // Call cp function
-    cp(args[1], args[2], 0);
+    cp(mountedFs, args[1], args[2], 0);
 
     p_exit();
 }
@@ -180,7 +187,7 @@ void shellRm(char *args[]) {
     int ind = 0;
     while (args[ind] != NULL) {
         if (ind > 0) {
-            deleteFile(args[ind]);
+            f_unlink(args[ind]);
         }
         ind += 1;
     }
@@ -200,7 +207,7 @@ void shellRm(char *args[]) {
 //     None
 void shellChmod(char *args[]) {
     // Call chmod function
-    chmod(args[1], atoi(args[2]));
+    chmod(mountedFs, args[1], atoi(args[2]));
 
     p_exit();
 }
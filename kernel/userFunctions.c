@@ -25,14 +25,16 @@
 #include "fat_fs/headers.h"
 #include "fat_fs/mkfs.h"
 #include "fat_fs/touch.h"
+#include "fat_fs/image.h"
+#include "fileTable.h"
 
 extern pcb *currentProcessPcb;
 extern ucontext_t *kernelContext;
 extern ucontext_t *newContext;
 extern linkedList *waitpidBlocked;
-extern linkedList *sleepBlocked;
 extern int currentProcessPid;
 extern int foregroundProcessPid;
+extern fileSystem *mountedFs;
 
 // Function to implement p_spawn. Spawns a new process. NOTE: The array argv 
 // must be null terminated. 
@@ -83,56 +85,17 @@ int dup2Func(int oldFd, int newFd, pcb *processPcb) {
     // If oldFd and newFd are the same, do nothing
     if (oldFd == newFd) return 0;
     
-    char *fileName = NULL;
-    int mode;
-    uint32_t loc;
-    // Get the file pointed to by oldFd
-    lNode *currNode = processPcb -> fdTable -> head;
-    while (currNode != NULL) {
-        fdEntry *entry = (fdEntry*)(currNode -> payload);
-        if ((entry -> fd) == oldFd) { // We have found the entry for oldFd
-            fileName = entry -> fileName;
-            mode = entry -> mode;
-            loc = entry -> loc;
-            break;
-        }
-        currNode = currNode -> next;
-    }
-    // If fileName is still null, then oldFd does not exist
-    if (fileName == NULL) return -1;
+    // Get the open file description pointed to by oldFd
+    int desc = getFdDesc(processPcb, oldFd);
+    // If desc is -1, then oldFd does not exist
+    if (desc == -1) return -1;
     
-    // Malloc a new string for the new entry and copy fileName over to the new 
-    // string
-    char *copy = malloc(strlen(fileName) + 1);
-    strcpy(copy, fileName);
-    // Find newFd and replace the file it points to with fileName, if newFd exists
-    currNode = processPcb -> fdTable -> head;
-    while (currNode != NULL) {
-        fdEntry *entry = (fdEntry*)(currNode -> payload);
-        if ((entry -> fd) == newFd) { 
-            // Free the string that entry -> fileName currently points to
-            free(entry -> fileName);
-            // Set the new string
-            entry -> fileName = copy;
-            // Set the other fields so that all fields for the newFd entry are 
-            // the same as those for the oldFd entry
-            entry -> mode = mode;
-            entry -> loc = loc; 
-
-            return 0;
-        }
-        currNode = currNode -> next;
-    }
-    // If we get here, then newFd does not exist and needs to be created
-    fdEntry *newEntry = malloc(sizeof(fdEntry));
-    newEntry -> fd = newFd;
-    newEntry -> fileName = copy;
-    // Set the other fields so that all fields for the newFd entry are 
-    // the same as those for the oldFd entry
-    newEntry -> mode = mode;
-    newEntry -> loc = loc; 
-    // Add newEntry to fdTable
-    addNodeTail(processPcb -> fdTable, newEntry);
+    // newFd will share the open file description (and so the file offset) of 
+    // oldFd. If newFd is open, release the description it currently points to
+    retainDesc(desc);
+    if (getFdDesc(processPcb, newFd) != -1) 
+        releaseDesc(getFdDesc(processPcb, newFd));
+    setFd(processPcb, newFd, desc);
 
     return 0;
 }
@@ -293,7 +256,7 @@ int p_nice(int pid, int priority) {
 //     None
 void p_sleep(unsigned int ticks) {
     // Block the calling process
-    blockProcess(currentProcessPcb -> pid, sleepBlocked, ticks);
+    blockProcess(currentProcessPcb -> pid, NULL, ticks);
     // Swap from calling thread to kernel thread
     swapcontext(currentProcessPcb -> uc, kernelContext);
 }
@@ -307,58 +270,51 @@ void p_sleep(unsigned int ticks) {
 // Returns: 
 //     File descriptor of the new file on success, -1 otherwise
 int f_open(char *fileName, int mode) {
-    // If mode is F_READ and file does not exist, return -1
-    if (mode == F_READ && findFile(fileName) == -1)
-        return -1;
-
     // If mode is F_WRITE and an instance of the file is already open with mode 
     // F_WRITE, return -1
     if (mode == F_WRITE) {
-        lNode *currNode = currentProcessPcb -> fdTable -> head;
-        while (currNode != NULL) {
-            fdEntry *entry = (fdEntry*)(currNode -> payload);
-            if (strcmp(entry -> fileName, fileName) == 0)
-                if ((entry -> mode) == F_WRITE)
-                    return -1;
-            currNode = currNode -> next;
-        }
+        if (isOpenForWriting(fileName))
+            return -1;
         // If we get here, then truncate fileName if it exists, and create it 
-        // otherwise
-        deleteFile(fileName);
-        createNewFile(fileName, REG_FILE, YYN);
+        // otherwise. The file is truncated in place, so that other file 
+        // descriptors for it stay valid
+        if (truncateFile(mountedFs, fileName) == -1 && 
+                createNewFile(mountedFs, fileName, REG_FILE, YYN) == -1) 
+            return -1;
     }
 
-    // Create and initialize new fdTable entry
-    fdEntry *entry = malloc(sizeof(fdEntry));
-    char *str = malloc(strlen(fileName) + 1);
-    strcpy(str, fileName);
-    entry -> fd = getNewFd(currentProcessPcb);
-    entry -> fileName = str;
-    entry -> mode = mode;
-    entry -> loc = 0;
-
-    // If mode is F_APPEND, create the file if it does not exist. If it exists,
-    // set loc in the fdTable entry to the end of the file
-    if (mode == F_APPEND) {
-        if (findFile(fileName) == -1) {
-            createNewFile(fileName, REG_FILE, YYN);
-        } else {
-            entry -> loc = getFileSize(fileName);
-        }
+    // If mode is F_APPEND, create the file if it does not exist
+    if (mode == F_APPEND && findFile(mountedFs, fileName) == -1) {
+        if (createNewFile(mountedFs, fileName, REG_FILE, YYN) == -1) 
+            return -1;
     }
 
-    // Add new fdTable entry to fdTable
-    addNodeTail(currentProcessPcb -> fdTable, entry);
+    // Create a new open file description for the file. If mode is F_READ and the
+    // file does not exist, this fails and we return -1
+    int desc = openDesc(fileName, mode);
+    if (desc == -1) return -1;
 
-    return entry -> fd;
+    // Point the lowest unused file descriptor to the new description
+    int fd = getNewFd(currentProcessPcb);
+    setFd(currentProcessPcb, fd, desc);
+
+    return fd;
 }
 
 
-// TODO: IMPLEMENT ABILITY TO ALLOW FILE OFFSET OF A FILE DESCRIPTOR TO BE 
-// BEYOND THE END OF THE FILE (SEE MAN PAGE FOR LSEEK) FOR F_READ/F_WRITE. FOR 
-// NOW, THE BEHAVIOR IS UNDEFINED IF FILE OFFSET IS BEYOND THE END OF A FILE
-// TODO: Note that f_read essentially ignore the specification "returns
-// 0 if EOF is reached"
+// Function to find the open file description a file descriptor of the calling 
+// process points to
+// Arguments: 
+//     fd: The file descriptor 
+// Returns: 
+//     A pointer to the open file description, or NULL if fd does not exist
+static openFileDesc *findDesc(int fd) {
+    int desc = getFdDesc(currentProcessPcb, fd);
+    if (desc == -1) return NULL;
+
+    return getDesc(desc);
+}
+
 
 // Function to implement f_read.
 // Arguments: 
@@ -366,22 +322,16 @@ int f_open(char *fileName, int mode) {
 //     buf: The buffer to put the read bytes in 
 //     n: The number of bytes to read 
 // Returns: 
-//     Number of bytes read on success, -1 on failure (eg: fd does not exist)
+//     Number of bytes read on success (0 if the end of the file has been 
+//     reached), -1 on failure (eg: fd does not exist)
 int f_read(int fd, char *buf, int n) {
-    // Find the fdTable entry associated with fd
-    fdEntry *entry = NULL;
-    lNode *currNode = currentProcessPcb -> fdTable -> head;
-    while (currNode != NULL) {
-        entry = (fdEntry*)(currNode -> payload);
-        if ((entry -> fd) == fd) // We have found the desired entry
-            break;
-        currNode = currNode -> next;
-    }
-    // If currNode is null here, fd does not exist
-    if (currNode == NULL) return -1;
+    // Find the open file description associated with fd
+    openFileDesc *desc = findDesc(fd);
+    // If desc is null here, fd does not exist
+    if (desc == NULL) return -1;
 
-    if (strcmp(entry -> fileName, "stdin") == 0) { // We need to read from stdin (ie:
-                                                // the terminal)
+    if ((desc -> type) == STDIN_DESC) { // We need to read from stdin (ie: the 
+                                        // terminal)
         // If calling process is not the foreground process, send the calling
         // process a S_SIGSTOP signal and return -1
         if (foregroundProcessPid != currentProcessPid) {
@@ -389,112 +339,89 @@ int f_read(int fd, char *buf, int n) {
             return -1;
         }
         return read(STDIN_FILENO, buf, n);
+    } else if ((desc -> type) == STDOUT_DESC) { // stdout cannot be read from
+        return -1;
     } else { // We are reading from a file in the FAT filesystem
-        // Read in the entire file
-        uint32_t fileSize;
-        char *fullFile = readFile(entry -> fileName, &fileSize);
-        // Get file offset of fd
-        uint32_t loc = entry -> loc;
-        // Set n to the number of bytes to be read from fullFile (ie: set n to 
-        // min(n, fileSize - loc))
-        n = (n < fileSize - loc) ? n : fileSize - loc;
-        // Read the bytes from fullFile to buf
-        for (int i = 0; i < n; i++) 
-            buf[i] = fullFile[loc + i];
-        // Advance the loc field in entry
-        entry -> loc += n;
-        // Free fullFile
-        free(fullFile);
+        // Read only the requested range, starting at the file offset of fd
+        int numRead = readFileAt(mountedFs, &(desc -> handle), desc -> loc, buf, n);
+        // Advance the file offset
+        desc -> loc += numRead;
         
         // Return the number of bytes read
-        return n;
+        return numRead;
     }
 }
 
 
-// Function to implement f_write. 
+// Function to implement f_write. If the file offset of fd is beyond the end of
+// the file, the gap is filled with zeros
 // Arguments: 
 //     fd: File descriptor of the file to write to 
 //     str: The string from which to write to the target file 
 //     n: The number of bytes to write 
 // Returns: 
-//     The number of bytes written on success, or -1 on error (eg: fd does not 
-//     exist)
+//     The number of bytes written, which is less than n if the filesystem ran out
+//     of free blocks partway through, or -1 on error (eg: fd does not exist, no 
+//     byte could be written)
 int f_write(int fd, char *str, int n) {
-    // Find the fdTable entry associated with fd
-    fdEntry *entry = NULL;
-    lNode *currNode = currentProcessPcb -> fdTable -> head;
-    while (currNode != NULL) {
-        entry = (fdEntry*)(currNode -> payload);
-        if ((entry -> fd) == fd) // We have found the desired entry
-            break;
-        currNode = currNode -> next;
-    }
-    // If currNode is null here, fd does not exist
-    if (currNode == NULL) return -1;
+    // Find the open file description associated with fd
+    openFileDesc *desc = findDesc(fd);
+    // If desc is null here, fd does not exist
+    if (desc == NULL) return -1;
     // If fd exists but is read only, return -1
-    if ((entry -> mode) == F_READ) return -1;
+    if ((desc -> mode) == F_READ) return -1;
     
-    // If fd is associated with file stdout, then write to stdout
-    if (strcmp(entry -> fileName, "stdout") == 0) 
+    // If fd is associated with stdout, then write to stdout
+    if ((desc -> type) == STDOUT_DESC) 
         return write(STDOUT_FILENO, str, n);
 
-    // Read in the full file
-    uint32_t fileSize;
-    char *fullFile = readFile(entry -> fileName, &fileSize);
-    // Get file offset
-    int loc = entry -> loc;
-    // Calculate the final file size after the write is completed
-    uint32_t finalSize = (n + loc < fileSize) ? fileSize : n + loc;
-    // Allocate a buffer that will contain the final contents of the file
-    char buffer[finalSize];
-    // Write to buffer
-    for (int i = 0; i < loc; i++)
-        buffer[i] = fullFile[i];
-    for (int i = 0; i < n; i++) 
-        buffer[i + loc] = str[i];
-    for (int i = loc + n; i < fileSize; i++) 
-        buffer[i] = fullFile[i];
-    // Write buffer to the file
-    writeFile(entry -> fileName, buffer, finalSize, 0);
-    // Advance loc field in entry
-    entry -> loc += n;
+    // Write the bytes in place, starting at the file offset of fd
+    int numWritten = writeFileAt(mountedFs, &(desc -> handle), desc -> loc, str, n);
+    if (numWritten == -1) return -1;
+    // Advance the file offset past the bytes that were written
+    desc -> loc += numWritten;
 
     // Return number of bytes written
-    return n;
+    return numWritten;
 }
 
 
 
 
-// Function to implement f_close. Removes the associated fdTable entry from 
-// fdTable
+// Function to implement f_close. Removes the file descriptor from the file 
+// descriptor table
 // Arguments: 
 //     fd: File descriptor to close 
 // Returns: 
 //     0 on success, -1 on failure (eg: fd does not exist)
 int f_close(int fd) {
-    // Find entry associated with this file descriptor in fdTable
-    lNode *currNode = currentProcessPcb -> fdTable -> head;
-    while (currNode != NULL) {
-        fdEntry *entry = (fdEntry*)(currNode -> payload);
-        if ((entry -> fd) == fd) { // We have found the desired entry
-            // Remove the entry from the file descriptor table
-            free(entry -> fileName);
-            removeNode(currentProcessPcb -> fdTable, currNode);
-            return 0;
-        }
-        currNode = currNode -> next;
-    }
+    // Find the open file description associated with this file descriptor
+    int desc = getFdDesc(currentProcessPcb, fd);
+    // If desc is -1, then fd does not exist
+    if (desc == -1) return -1;
+
+    // Release the open file description and remove fd from the file descriptor
+    // table
+    releaseDesc(desc);
+    removeFd(currentProcessPcb, fd);
+    // Write the FAT entries modified while the file was open back to the 
+    // filesystem and apply the image's durability policy
+    syncImage(mountedFs);
 
-    return -1;
+    return 0;
 }
 
 
-// Function to implement f_unlink. TODO: CREATE CENTRAL TABLE WITH ALL FILES 
-// AND ALL PROCESS' REFERENCES TO THEM TO KEEP TRACK OF WHETHER A FILE IS IN USE
-// BY A PROCESS OR NOT
-// TODO: IMPLEMENT F_UNLINK FUNCTION
+// Function to implement f_unlink. Deletes a file from the FAT filesystem. If the
+// file is open by any process, it is removed from the directory now, but its 
+// blocks are only freed when it is closed for the last time
+// Arguments: 
+//     fileName: Name of the file to delete 
+// Returns: 
+//     0 on success, -1 on failure (eg: the file does not exist)
+int f_unlink(char *fileName) {
+    return unlinkOpenFile(fileName);
+}
 
 
 // Function to implement f_lseek. 
@@ -506,27 +433,21 @@ int f_close(int fd) {
 //     The file offset from the start of the file after the seek is performed on 
 //     success, -1 otherwise
 int f_lseek(int fd, int offset, int whence) {
-    // Find the fdTable entry for the file descriptor
-    lNode *currNode = currentProcessPcb -> fdTable -> head;
-    while (currNode != NULL) {
-        fdEntry *entry = (fdEntry*)(currNode -> payload);
-        if ((entry -> fd) == fd) { // We have found the desired fdTable entry
-            // Set the loc field in entry based on whence
-            if (whence == F_SEEK_SET) 
-                entry -> loc = offset;
-            else if (whence == F_SEEK_CUR) 
-                entry -> loc += offset;
-            else if (whence == F_SEEK_END)
-                entry -> loc = offset + getFileSize(entry -> fileName);
-            
-            // Return the offset from the beginning of the file
-            return entry -> loc;
-        }
-        currNode = currNode -> next;
-    }
-
-    // If we get here, then we know fd does not exist
-    return -1;
+    // Find the open file description for the file descriptor
+    openFileDesc *desc = findDesc(fd);
+    // If desc is null here, fd does not exist
+    if (desc == NULL) return -1;
+
+    // Set the file offset based on whence
+    if (whence == F_SEEK_SET) 
+        desc -> loc = offset;
+    else if (whence == F_SEEK_CUR) 
+        desc -> loc += offset;
+    else if (whence == F_SEEK_END && (desc -> type) == FILE_DESC)
+        desc -> loc = offset + getHandleSize(mountedFs, &(desc -> handle));
+    
+    // Return the offset from the beginning of the file
+    return desc -> loc;
 }
 
 
@@ -19,6 +19,7 @@ int f_open(char *fileName, int mode);
 int f_read(int fd, char *buf, int n);
 int f_write(int fd, char *str, int n);
 int f_close(int fd);
+int f_unlink(char *fileName);
 int f_lseek(int fd, int offset, int whence);
 
 